@@ -8,6 +8,10 @@
 /* C libraries needed */
 #include <R.h>
 #include <math.h>
+#include <float.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /* You need to define number of parameters and forcing functions passed to the model here */
 /* These must match number in intializer functions below */
@@ -257,6 +261,75 @@ static double forc[166];
 #define HIV_test forc[164] /* proportion of notifed TB cases tested for HIV */
 #define ART_link forc[165] /* proportion of those tested positive linked to ART */
 
+/* ###### MODEL VARIANTS ###### */
+
+/* Drug resistance, the post PT states and HIV/ART can be left out of the model by defining NO_MDR, NO_PT and/or NO_HIV when compiling */
+/* e.g. PKG_CPPFLAGS="-DNO_MDR -DNO_HIV" R CMD SHLIB -o TB_model_noMDR_noHIV.dll TB_model.c (Libraries_and_dll.R does this) */
+/* The states that are left out are not in y (so the solver doesn't carry them) and are held at zero in the equations */
+/* NO_MDR - no Lm, Nm or Im states and no acquisition of resistance (e = 0) */
+/* NO_PT  - no PTn/PTp states, false positive Rx of latent infection leaves people in the latent state */
+/* NO_HIV - no HIV+ or ART states and no HIV incidence */
+#ifdef NO_MDR
+#define MDR_ON 0
+#undef e
+#define e 0.0
+#else
+#define MDR_ON 1
+#endif
+
+#ifdef NO_PT
+#define PT_ON 0
+#else
+#define PT_ON 1
+#endif
+
+#ifdef NO_HIV
+#define HIV_ON 0
+#else
+#define HIV_ON 1
+#endif
+
+/* Disease states in the order they are stored in y and whether they are in this variant */
+/*                          S  Lsn Lsp Lmn     Lmp     Nsn Nsp Nmn     Nmp     Isn Isp Imn     Imp     PTn    PTp */
+static const int dis_on[15] = {1, 1,  1,  MDR_ON, MDR_ON, 1,  1,  MDR_ON, MDR_ON, 1,  1,  MDR_ON, MDR_ON, PT_ON, PT_ON};
+
+/* ###### SCALAR TYPE USED IN THE MODEL EQUATIONS ###### */
+
+/* The equations (model_kernel) are written with tb_real rather than double so they can also be compiled with complex numbers */
+/* Compiling with -DTB_COMPLEX_STEP gives a dll whose jvp_cs function returns exact directional derivatives of the rates of change */
+/* and outputs (complex step differentiation: f(x + ih*v) = f(x) + ih*J*v + O(h^2) so J*v = Im(f)/h to machine precision for tiny h) */
+/* Comparisons and fmin/fmax use the real part, so the clamps on the HIV/ART tables and mortality adjustment pick the same branch */
+#ifdef TB_COMPLEX_STEP
+#include <complex.h>
+typedef double complex tb_real;
+#define tb_re(x) creal(x)
+static inline tb_real tb_fmin(tb_real x, tb_real y){ return creal(x)<=creal(y) ? x : y; }
+static inline tb_real tb_fmax(tb_real x, tb_real y){ return creal(x)>=creal(y) ? x : y; }
+#define tb_pow(x,y) cpow(x,y)
+#elif defined(TB_FLOAT)
+typedef float tb_real;
+#define tb_re(x) (x)
+#define tb_fmin(x,y) fminf(x,y)
+#define tb_fmax(x,y) fmaxf(x,y)
+#define tb_pow(x,y) powf(x,y)
+#else
+typedef double tb_real;
+#define tb_re(x) (x)
+#define tb_fmin(x,y) fmin(x,y)
+#define tb_fmax(x,y) fmax(x,y)
+#define tb_pow(x,y) pow(x,y)
+#endif
+
+/* Compiling with -DTB_FLOAT gives a single precision dll (TB_model_float, see precision in Main.R) for fast screening runs - the */
+/* state, rates of change and all the per compartment arithmetic are float, but population totals (Total, tot_age and the */
+/* denominator of the force of infection) are added up in double (tb_acc). The solver still stores the state and does its */
+/* error control in double. Precision_report.R compares it with the double model for each country */
+#ifdef TB_FLOAT
+typedef double tb_acc;
+#else
+typedef tb_real tb_acc;
+#endif
+
 /* ###### FUNCTION TO SUM ARRAY FROM ELEMENT i_start TO i_end ###### */
 double sumsum(double ar[], int i_start, int i_end)
 {
@@ -269,6 +342,21 @@ double sumsum(double ar[], int i_start, int i_end)
    return(sum);
 }
 
+#if defined(TB_COMPLEX_STEP) || defined(TB_FLOAT)
+static tb_acc tb_sumsum(tb_real ar[], int i_start, int i_end)
+{
+   int i=0;
+   tb_acc sum=0;
+   for (i=i_start; i<=i_end; i++)
+   {
+    sum = sum + ar[i];
+   }
+   return(sum);
+}
+#else
+#define tb_sumsum sumsum
+#endif
+
 /* ###### FUNCTION TO INITIALIZE PARAMETERS PASSED FROM R - if the number of parameters is changed you must update N here ###### */
 void parmsc(void (* odeparms)(int *, double *))
 {
@@ -283,71 +371,267 @@ void forcc(void (* odeforcs)(int *, double *))
     odeforcs(&N, forc);
 }
 
+/* ###### CHECKSUM (64 bit FNV-1a) OF A BLOCK OF BYTES - USED TO VALIDATE CHECKPOINT FILES (Checkpoint.R) ###### */
+/* Called from R with .C("fnv_hash", x, length(x), h=integer(2)) where x is a raw vector, returns the hash as two 32 bit halves in h */
+void fnv_hash(unsigned char *x, int *n, int *h)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    int i;
+    for (i=0; i<*n; i++){
+      hash = (hash ^ x[i])*1099511628211ULL;
+    }
+    h[0] = (int)(unsigned int)(hash >> 32);
+    h[1] = (int)(unsigned int)(hash & 0xffffffffULL);
+}
+
+/* ###### ACCUMULATORS - ANNUAL TOTALS OF FLOWS (CASES, DEATHS, NOTIFICATIONS) INTEGRATED ALONGSIDE THE MODEL ###### */
+/* If 2*N_ACC extra states are added to the end of the full state vector the model integrates the flows below into the first N_ACC */
+/* At each event these are moved into the second N_ACC and reset to zero, so the output at year t has the totals from t-1 to t */
+/* The order is Cases_neg, Cases_pos, Cases_ART, TB_deaths_neg, TB_deaths_pos, HIV_deaths, Deaths, */
+/* DS_correct, DS_incorrect, MDR_correct, MDR_incorrect, FP (see acc_names in Run_model.R) */
+
+#define N_ACC 12
+#define N_DIS (15 - 6*(1-MDR_ON) - 2*(1-PT_ON))     /* Number of disease states in this variant */
+#define N_STATES (81*N_DIS*(1+HIV_ON*7*4))           /* Number of states in the full model */
+
+/* Number of model states (without accumulators) in a state vector of length n */
+static int model_states(int n)
+{
+    return n==N_STATES+2*N_ACC ? N_STATES : n;
+}
+
+/* ###### THREADS - THE AGE LOOPS IN THE MODEL CAN BE SPLIT ACROSS THREADS IF COMPILED WITH OPENMP (see Libraries_and_dll.R) ###### */
+/* Each thread does a block of ages and any totals over ages are added up afterwards in age order, so the results are */
+/* exactly the same whatever the number of threads */
+
+/* TB_OMP_FOR(clauses) goes before a loop to split it across the threads - it is empty if not compiled with OpenMP */
+#ifdef _OPENMP
+static int tb_threads = 1;
+#define TB_PRAGMA(x) _Pragma(#x)
+#define TB_OMP_FOR(clauses) TB_PRAGMA(omp parallel for clauses num_threads(tb_threads) if(tb_threads>1))
+#else
+#define TB_OMP_FOR(clauses)
+#endif
+
+/* Called from R with .C("set_threads", n) - n is set to the number of threads that will be used (1 if not compiled with OpenMP) */
+void set_threads(int *n)
+{
+#ifdef _OPENMP
+    if (*n<1) *n = 1;
+    if (*n>omp_get_num_procs()) *n = omp_get_num_procs();
+    tb_threads = *n;
+#else
+    if (*n>1) warning("model wasn't compiled with OpenMP so runs on one thread");
+    *n = 1;
+#endif
+}
+
+/* ###### OPERATOR SPLITTING - DEMOGRAPHY APPLIED EXACTLY BETWEEN SOLVER STEPS (see split_dt in Run_model.R) ###### */
+/* Background mortality (m_b), migration and HIV incidence are linear in the state for given rates. In split mode the model */
+/* leaves them out of the rates of change and event_split applies them exactly (as exponentials of the rates by age) every */
+/* split_dt years - Strang splitting: half a step of demography, aging and births at whole years, then another half step, */
+/* with the solver only doing the TB/HIV part in between. The rates are those at the state at the event (m_b and the migration */
+/* rate depend on the population) held constant over each half step */
+
+static int tb_split = 0;            /* 1 = the model leaves out the demography */
+static int split_get = 0;           /* 1 = the model stores the demography rates below */
+static double split_dt = 1, split_t0 = 0, split_t1 = 0;
+static double split_q[81];          /* migration minus background mortality rate by age */
+static double split_h[81];          /* HIV incidence by age */
+static double split_cd4[81][7];     /* CD4 category of new HIV infections by age */
+
+/* Called from R with .C("set_split", on, dt, t0, t1) before each run - t0 and t1 are the start and end of the run */
+void set_split(int *on, double *dt, double *t0, double *t1)
+{
+    if (*on && *dt<=0) error("split step must be positive");
+    tb_split = *on;
+    split_dt = *dt;
+    split_t0 = *t0;
+    split_t1 = *t1;
+}
+
+/* ###### AGING - ANNUAL EVENTS (THE DEFAULT) OR CONTINUOUS (see aging in Run_model.R) ###### */
+/* With continuous aging everyone moves up an age group at a rate of 1 a year (the last group, 80+, has no outflow) and births */
+/* go into S in age 0 as they happen, both as terms in the rates of change - so the solver doesn't have to stop at each year. */
+/* event() then only moves the accumulators (if any) */
+
+static int tb_aging = 0;    /* 0 = annual events, 1 = continuous */
+
+/* Called from R with .C("set_aging", continuous) */
+void set_aging(int *continuous)
+{
+    tb_aging = *continuous;
+}
+
+/* ###### AGE MIXING - FORCE OF INFECTION FROM A CONTACT MATRIX (see contact in Run_model.R and Contact.R) ###### */
+/* By default mixing is homogeneous - the force of infection is the same at every age, from the infectious TB in the whole */
+/* population. With a contact matrix C the force of infection at age i is sum_j C[i][j]*x[j], where x[j] is beta times the */
+/* infectious TB at age j over the population at age j (so C[i][j] = pop[j]/Total everywhere gives homogeneous mixing back). */
+/* x is worked out once per call and DS and DR go through C together so each entry is read once. C is passed in full */
+/* (n_age x n_age) or as low rank factors C = U*V' (n_age x rank each) - the product is then V'x first (rank values a strain) */
+/* and U times that, 4*n_age*rank operations rather than 2*n_age*n_age */
+
+static int tb_contact = 0;             /* 0 = homogeneous, 1 = full matrix, 2 = low rank */
+static int contact_n = 0;              /* number of ages */
+static int contact_rank = 0;
+static double contact_U[81*81];        /* C (n_age x n_age) or U (n_age x rank), row major */
+static double contact_V[81*81];        /* V (n_age x rank), row major */
+
+/* Called from R with .C("set_contact", mode, n_age, rank, U, V) - U is C for mode 1 (rank and V are then not used) */
+void set_contact(int *mode, int *n, int *rank, double *U, double *V)
+{
+    int i;
+    if (*mode<0 || *mode>2) error("contact mode must be 0, 1 or 2");
+    if (*mode>0 && *n!=81) error("contact matrix must be 81 x 81 for this model");
+    if (*mode==2 && (*rank<1 || *rank>81)) error("contact rank must be between 1 and 81");
+    tb_contact = *mode;
+    contact_n = *n;
+    contact_rank = *mode==2 ? *rank : *n;
+    if (*mode==1) for (i=0; i<(*n)*(*n); i++) contact_U[i] = U[i];
+    if (*mode==2){
+      for (i=0; i<(*n)*(*rank); i++){
+        contact_U[i] = U[i];
+        contact_V[i] = V[i];
+      }
+    }
+}
+
+/* Force of infection by age (FS_age, FM_age) from x for each strain (xs, xm) */
+static void contact_foi(tb_real *xs, tb_real *xm, tb_acc *FS_age, tb_acc *FM_age)
+{
+    int i, j, k;
+    int n = contact_n, rk = contact_rank;
+    if (tb_contact==1){
+      for (i=0; i<n; i++){
+        const double *Ci = contact_U + i*n;
+        tb_acc fs = 0, fm = 0;
+        for (j=0; j<n; j++){
+          fs += Ci[j]*xs[j];
+          fm += Ci[j]*xm[j];
+        }
+        FS_age[i] = fs;
+        FM_age[i] = fm;
+      }
+    }
+    else {
+      tb_acc ws[81] = {0}, wm[81] = {0};
+      for (j=0; j<n; j++){
+        const double *Vj = contact_V + j*rk;
+        for (k=0; k<rk; k++){
+          ws[k] += Vj[k]*xs[j];
+          wm[k] += Vj[k]*xm[j];
+        }
+      }
+      for (i=0; i<n; i++){
+        const double *Ui = contact_U + i*rk;
+        tb_acc fs = 0, fm = 0;
+        for (k=0; k<rk; k++){
+          fs += Ui[k]*ws[k];
+          fm += Ui[k]*wm[k];
+        }
+        FS_age[i] = fs;
+        FM_age[i] = fm;
+      }
+    }
+}
+
 /* ##### EVENTS ARE USED TO ADD BIRTHS AND SHIFT THE POPULATION BY AGE - EQUIVALENT TO THE METHOD OF SCHENZLE ###### */
 
-void event(int *n, double *t, double *y) 
+/* Aging and births for one model state - b_rate is the birth rate to use (event_patch passes each patch's own) */
+static void age_births(int *n, double *y, double b_rate)
 {
   int i;
   
+  /* n is the number of states passed in - all of them (maybe with accumulators), or just the HIV- states in the equilibrium run */
+  int nm = model_states(*n);
+  
+  /* Move the accumulated totals for the year just finished and start the next year from zero */
+  if (nm < *n){
+    for (i=0; i<N_ACC; i++){
+      y[nm+N_ACC+i] = y[nm+i];
+      y[nm+i] = 0;
+    }
+  }
+  
+  /* With continuous aging there is nothing else to do (see AGING above) */
+  if (tb_aging) return;
+  
   /* Store current population in temp and shift every age group forward one */
   double temp[35235];
   temp[0] = y[0];
-  for (i=1; i<35235; i++){
+  for (i=1; i<nm; i++){
     temp[i] = y[i];
     y[i] = temp[i-1];
   }
   /* Set every 0 age group to zero and every >80 age group to the previous age group plus those still surviving  */
-  for (i=0; i<35235; i+=81) {
+  for (i=0; i<nm; i+=81) {
     y[i] = 0;
     y[i+80] = temp[i+80] + temp[i+79];  
   }
   /* Then add births into group 0 - only susceptibles get born */ 
-  y[0] = birth_rate*sumsum(temp,0,35234)/1000;
+  y[0] = b_rate*sumsum(temp,0,nm-1)/1000;
+}
+
+void event(int *n, double *t, double *y) 
+{
+  age_births(n, y, birth_rate);
 }
 
 /* ###### DERIVATIVE FUNCTIONS - THIS IS THE MODEL ITSELF ###### */
 
-void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip)
+/* Checks the number of states and outputs passed to model_kernel - everything that calls model_kernel does these checks first, */
+/* so model_kernel itself never stops with an error (which mustn't happen in the threads running the patches) */
+static void model_check(int *neq, int *ip, tb_real *parms)
 {
     if (ip[0] <2) error("nout should be at least 2");
-    
+    if (*neq == 81*N_DIS){
+      if (tb_re(HIV_run)>0.0 && HIV_ON) error("HIV_run must be 0 if only the HIV- states are passed in");
+    }
+    else if (*neq != N_STATES && *neq != N_STATES+2*N_ACC) error("number of states doesn't match this model variant");
+}
+
+/* parms and forc are passed in (rather than using the static arrays directly) so that the parameter macros above refer to */
+/* whichever arrays are passed - the static ones from derivs1, or perturbed complex copies from jvp_cs */
+/* mix is NULL except for the patches (see PATCHES below), where it is the infectious TB mixed over the patches */
+static void model_kernel(int *neq, double *t, tb_real *y, tb_real *ydot, tb_real *yout, int *ip, tb_real *parms, tb_real *forc, const double *mix)
+{
     /* Expand state variables so can use more meaningful names than y and ydot (the variables and rates of change are vectors y and ydot here) */
     /* There are 81 age groups, 7 HIV positive categories and 3 times on ART */
     /* _H = HIV+; _A = HIV+ on ART */
     
     /* These are the variables */
-    double S[81]={0};   double S_H[81][7]={{0}};   double S_A[81][7][3]={{{0}}};      /* Susceptible */
-    double Lsn[81]={0}; double Lsn_H[81][7]={{0}}; double Lsn_A[81][7][3]={{{0}}};    /* Latent, DS, new */
-    double Lsp[81]={0}; double Lsp_H[81][7]={{0}}; double Lsp_A[81][7][3]={{{0}}};    /* Latent, DS, previous */
-    double Lmn[81]={0}; double Lmn_H[81][7]={{0}}; double Lmn_A[81][7][3]={{{0}}};    /* Latent, DR, new */
-    double Lmp[81]={0}; double Lmp_H[81][7]={{0}}; double Lmp_A[81][7][3]={{{0}}};    /* Latent, DR, previous */
-    double Nsn[81]={0}; double Nsn_H[81][7]={{0}}; double Nsn_A[81][7][3]={{{0}}};    /* Smear negative, DS, new */
-    double Nsp[81]={0}; double Nsp_H[81][7]={{0}}; double Nsp_A[81][7][3]={{{0}}};    /* Smear negative, DS, previous */
-    double Nmn[81]={0}; double Nmn_H[81][7]={{0}}; double Nmn_A[81][7][3]={{{0}}};    /* Smear negative, DR, new */
-    double Nmp[81]={0}; double Nmp_H[81][7]={{0}}; double Nmp_A[81][7][3]={{{0}}};    /* Smear negative, DR, previous */
-    double Isn[81]={0}; double Isn_H[81][7]={{0}}; double Isn_A[81][7][3]={{{0}}};    /* Smear positive, DS, new */
-    double Isp[81]={0}; double Isp_H[81][7]={{0}}; double Isp_A[81][7][3]={{{0}}};    /* Smear positive, DS, previous */
-    double Imn[81]={0}; double Imn_H[81][7]={{0}}; double Imn_A[81][7][3]={{{0}}};    /* Smear positive, DR, new */
-    double Imp[81]={0}; double Imp_H[81][7]={{0}}; double Imp_A[81][7][3]={{{0}}};    /* Smear positive, DR, previous */
-    double PTn[81]={0}; double PTn_H[81][7]={{0}}; double PTn_A[81][7][3]={{{0}}};     /* Post PT, new - also move people here if they are false positive for TB and receive Rx */
-    double PTp[81]={0}; double PTp_H[81][7]={{0}}; double PTp_A[81][7][3]={{{0}}};     /* Post PT, previous - also move people here if they are false positive for TB and receive Rx */
+    tb_real S[81]={0};   tb_real S_H[81][7]={{0}};   tb_real S_A[81][7][3]={{{0}}};      /* Susceptible */
+    tb_real Lsn[81]={0}; tb_real Lsn_H[81][7]={{0}}; tb_real Lsn_A[81][7][3]={{{0}}};    /* Latent, DS, new */
+    tb_real Lsp[81]={0}; tb_real Lsp_H[81][7]={{0}}; tb_real Lsp_A[81][7][3]={{{0}}};    /* Latent, DS, previous */
+    tb_real Lmn[81]={0}; tb_real Lmn_H[81][7]={{0}}; tb_real Lmn_A[81][7][3]={{{0}}};    /* Latent, DR, new */
+    tb_real Lmp[81]={0}; tb_real Lmp_H[81][7]={{0}}; tb_real Lmp_A[81][7][3]={{{0}}};    /* Latent, DR, previous */
+    tb_real Nsn[81]={0}; tb_real Nsn_H[81][7]={{0}}; tb_real Nsn_A[81][7][3]={{{0}}};    /* Smear negative, DS, new */
+    tb_real Nsp[81]={0}; tb_real Nsp_H[81][7]={{0}}; tb_real Nsp_A[81][7][3]={{{0}}};    /* Smear negative, DS, previous */
+    tb_real Nmn[81]={0}; tb_real Nmn_H[81][7]={{0}}; tb_real Nmn_A[81][7][3]={{{0}}};    /* Smear negative, DR, new */
+    tb_real Nmp[81]={0}; tb_real Nmp_H[81][7]={{0}}; tb_real Nmp_A[81][7][3]={{{0}}};    /* Smear negative, DR, previous */
+    tb_real Isn[81]={0}; tb_real Isn_H[81][7]={{0}}; tb_real Isn_A[81][7][3]={{{0}}};    /* Smear positive, DS, new */
+    tb_real Isp[81]={0}; tb_real Isp_H[81][7]={{0}}; tb_real Isp_A[81][7][3]={{{0}}};    /* Smear positive, DS, previous */
+    tb_real Imn[81]={0}; tb_real Imn_H[81][7]={{0}}; tb_real Imn_A[81][7][3]={{{0}}};    /* Smear positive, DR, new */
+    tb_real Imp[81]={0}; tb_real Imp_H[81][7]={{0}}; tb_real Imp_A[81][7][3]={{{0}}};    /* Smear positive, DR, previous */
+    tb_real PTn[81]={0}; tb_real PTn_H[81][7]={{0}}; tb_real PTn_A[81][7][3]={{{0}}};     /* Post PT, new - also move people here if they are false positive for TB and receive Rx */
+    tb_real PTp[81]={0}; tb_real PTp_H[81][7]={{0}}; tb_real PTp_A[81][7][3]={{{0}}};     /* Post PT, previous - also move people here if they are false positive for TB and receive Rx */
 
     /* These are the rates of change (same names but prefixed with d) */
-    double dS[81]={0};   double dS_H[81][7]={{0}};   double dS_A[81][7][3]={{{0}}};
-    double dLsn[81]={0}; double dLsn_H[81][7]={{0}}; double dLsn_A[81][7][3]={{{0}}};
-    double dLsp[81]={0}; double dLsp_H[81][7]={{0}}; double dLsp_A[81][7][3]={{{0}}};
-    double dLmn[81]={0}; double dLmn_H[81][7]={{0}}; double dLmn_A[81][7][3]={{{0}}};
-    double dLmp[81]={0}; double dLmp_H[81][7]={{0}}; double dLmp_A[81][7][3]={{{0}}};
-    double dNsn[81]={0}; double dNsn_H[81][7]={{0}}; double dNsn_A[81][7][3]={{{0}}};
-    double dNsp[81]={0}; double dNsp_H[81][7]={{0}}; double dNsp_A[81][7][3]={{{0}}};
-    double dNmn[81]={0}; double dNmn_H[81][7]={{0}}; double dNmn_A[81][7][3]={{{0}}};
-    double dNmp[81]={0}; double dNmp_H[81][7]={{0}}; double dNmp_A[81][7][3]={{{0}}};
-    double dIsn[81]={0}; double dIsn_H[81][7]={{0}}; double dIsn_A[81][7][3]={{{0}}};
-    double dIsp[81]={0}; double dIsp_H[81][7]={{0}}; double dIsp_A[81][7][3]={{{0}}};
-    double dImn[81]={0}; double dImn_H[81][7]={{0}}; double dImn_A[81][7][3]={{{0}}};
-    double dImp[81]={0}; double dImp_H[81][7]={{0}}; double dImp_A[81][7][3]={{{0}}};
-    double dPTn[81]={0}; double dPTn_H[81][7]={{0}}; double dPTn_A[81][7][3]={{{0}}}; 
-    double dPTp[81]={0}; double dPTp_H[81][7]={{0}}; double dPTp_A[81][7][3]={{{0}}}; 
+    tb_real dS[81]={0};   tb_real dS_H[81][7]={{0}};   tb_real dS_A[81][7][3]={{{0}}};
+    tb_real dLsn[81]={0}; tb_real dLsn_H[81][7]={{0}}; tb_real dLsn_A[81][7][3]={{{0}}};
+    tb_real dLsp[81]={0}; tb_real dLsp_H[81][7]={{0}}; tb_real dLsp_A[81][7][3]={{{0}}};
+    tb_real dLmn[81]={0}; tb_real dLmn_H[81][7]={{0}}; tb_real dLmn_A[81][7][3]={{{0}}};
+    tb_real dLmp[81]={0}; tb_real dLmp_H[81][7]={{0}}; tb_real dLmp_A[81][7][3]={{{0}}};
+    tb_real dNsn[81]={0}; tb_real dNsn_H[81][7]={{0}}; tb_real dNsn_A[81][7][3]={{{0}}};
+    tb_real dNsp[81]={0}; tb_real dNsp_H[81][7]={{0}}; tb_real dNsp_A[81][7][3]={{{0}}};
+    tb_real dNmn[81]={0}; tb_real dNmn_H[81][7]={{0}}; tb_real dNmn_A[81][7][3]={{{0}}};
+    tb_real dNmp[81]={0}; tb_real dNmp_H[81][7]={{0}}; tb_real dNmp_A[81][7][3]={{{0}}};
+    tb_real dIsn[81]={0}; tb_real dIsn_H[81][7]={{0}}; tb_real dIsn_A[81][7][3]={{{0}}};
+    tb_real dIsp[81]={0}; tb_real dIsp_H[81][7]={{0}}; tb_real dIsp_A[81][7][3]={{{0}}};
+    tb_real dImn[81]={0}; tb_real dImn_H[81][7]={{0}}; tb_real dImn_A[81][7][3]={{{0}}};
+    tb_real dImp[81]={0}; tb_real dImp_H[81][7]={{0}}; tb_real dImp_A[81][7][3]={{{0}}};
+    tb_real dPTn[81]={0}; tb_real dPTn_H[81][7]={{0}}; tb_real dPTn_A[81][7][3]={{{0}}}; 
+    tb_real dPTp[81]={0}; tb_real dPTp_H[81][7]={{0}}; tb_real dPTp_A[81][7][3]={{{0}}}; 
 
     /* intergers to use as counters */ 
     int i,j,l,ij,iz;
@@ -359,45 +643,41 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
      
     /* HIV- */ 
     
-    int n_age = 81;     /* Number of age groups */
-    int n_HIV = 7;      /* Number of HIV pos groups */
-    int n_ART = 3;      /* Number of ART groups */
-    int n_disease = 15; /* Number of disease states */
+    int n_age = 81;       /* Number of age groups */
+    int n_HIV = 7*HIV_ON; /* Number of HIV pos groups */
+    int n_ART = 3;        /* Number of ART groups */
+    int n_disease = 0;    /* Number of disease states (in this variant) */
     
-    for (i=0; i<n_age; i++) S[i] = y[i];             
-    for (i=n_age; i<n_age*2; i++) Lsn[i-n_age] = y[i];       
-    for (i=n_age*2; i<n_age*3; i++) Lsp[i-n_age*2] = y[i];       
-    for (i=n_age*3; i<n_age*4; i++) Lmn[i-n_age*3] = y[i];    
-    for (i=n_age*4; i<n_age*5; i++) Lmp[i-n_age*4] = y[i];     
-    for (i=n_age*5; i<n_age*6; i++) Nsn[i-n_age*5] = y[i];      
-    for (i=n_age*6; i<n_age*7; i++) Nsp[i-n_age*6] = y[i];    
-    for (i=n_age*7; i<n_age*8; i++) Nmn[i-n_age*7] = y[i];    
-    for (i=n_age*8; i<n_age*9; i++) Nmp[i-n_age*8] = y[i];    
-    for (i=n_age*9; i<n_age*10; i++) Isn[i-n_age*9] = y[i];    
-    for (i=n_age*10; i<n_age*11; i++) Isp[i-n_age*10] = y[i];    
-    for (i=n_age*11; i<n_age*12; i++) Imn[i-n_age*11] = y[i];    
-    for (i=n_age*12; i<n_age*13; i++) Imp[i-n_age*12] = y[i];  
-    for (i=n_age*13; i<n_age*14; i++) PTn[i-n_age*13] = y[i];
-    for (i=n_age*14; i<n_age*15; i++) PTp[i-n_age*14] = y[i];
+    /* Pointers to the variables and rates of change in the order they are stored in y */
+    tb_real *X[15] = {S,Lsn,Lsp,Lmn,Lmp,Nsn,Nsp,Nmn,Nmp,Isn,Isp,Imn,Imp,PTn,PTp};
+    tb_real (*X_H[15])[7] = {S_H,Lsn_H,Lsp_H,Lmn_H,Lmp_H,Nsn_H,Nsp_H,Nmn_H,Nmp_H,Isn_H,Isp_H,Imn_H,Imp_H,PTn_H,PTp_H};
+    tb_real (*X_A[15])[7][3] = {S_A,Lsn_A,Lsp_A,Lmn_A,Lmp_A,Nsn_A,Nsp_A,Nmn_A,Nmp_A,Isn_A,Isp_A,Imn_A,Imp_A,PTn_A,PTp_A};
+    tb_real *dX[15] = {dS,dLsn,dLsp,dLmn,dLmp,dNsn,dNsp,dNmn,dNmp,dIsn,dIsp,dImn,dImp,dPTn,dPTp};
+    tb_real (*dX_H[15])[7] = {dS_H,dLsn_H,dLsp_H,dLmn_H,dLmp_H,dNsn_H,dNsp_H,dNmn_H,dNmp_H,dIsn_H,dIsp_H,dImn_H,dImp_H,dPTn_H,dPTp_H};
+    tb_real (*dX_A[15])[7][3] = {dS_A,dLsn_A,dLsp_A,dLmn_A,dLmp_A,dNsn_A,dNsp_A,dNmn_A,dNmp_A,dIsn_A,dIsp_A,dImn_A,dImp_A,dPTn_A,dPTp_A};
+    
+    /* Position of each disease state within each block of y (-1 if it isn't in this variant) */
+    int slot[15];
+    int k;
+    for (k=0; k<15; k++) slot[k] = dis_on[k] ? n_disease++ : -1;
+    
+    /* The equilibrium run only passes in the HIV- states (n_age*n_disease) - all HIV+ and ART states are then zero */
+    /* so setting n_HIV to 0 skips every HIV/ART loop below, including reading them from y and writing them to ydot */
+    /* If there are accumulators they start at y[acc] (see ACCUMULATORS above). Any other size has been stopped by model_check */
+    int acc = 0;
+    if (*neq == n_age*n_disease) n_HIV = 0;
+    else if (*neq == n_age*n_disease*(1+n_HIV+n_HIV*n_ART) + 2*N_ACC) acc = *neq - 2*N_ACC;
+    
+    for (k=0; k<15; k++){
+      if (slot[k]>=0) for (i=0; i<n_age; i++) X[k][i] = y[slot[k]*n_age+i];
+    }
     /* HIV+ */
     ij = n_age*n_disease;  
     for (j=0; j<n_HIV; j++){
       for (i=0; i<n_age; i++){  
-        S_H[i][j] = y[ij];
-        Lsn_H[i][j] = y[ij+(n_age*n_HIV)];
-        Lsp_H[i][j] = y[ij+(2*n_age*n_HIV)];
-        Lmn_H[i][j] = y[ij+(3*n_age*n_HIV)];
-        Lmp_H[i][j] = y[ij+(4*n_age*n_HIV)];  
-        Nsn_H[i][j] = y[ij+(5*n_age*n_HIV)];
-        Nsp_H[i][j] = y[ij+(6*n_age*n_HIV)];
-        Nmn_H[i][j] = y[ij+(7*n_age*n_HIV)];
-        Nmp_H[i][j] = y[ij+(8*n_age*n_HIV)];
-        Isn_H[i][j] = y[ij+(9*n_age*n_HIV)];
-        Isp_H[i][j] = y[ij+(10*n_age*n_HIV)];
-        Imn_H[i][j] = y[ij+(11*n_age*n_HIV)];
-        Imp_H[i][j] = y[ij+(12*n_age*n_HIV)];
-        PTn_H[i][j] = y[ij+(13*n_age*n_HIV)];
-        PTp_H[i][j] = y[ij+(14*n_age*n_HIV)];
+        for (k=0; k<15; k++){
+          if (slot[k]>=0) X_H[k][i][j] = y[ij+(slot[k]*n_age*n_HIV)];
+        }
         ij = ij+1;
       }
     }
@@ -406,21 +686,9 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
     for (l=0; l<n_ART; l++){                          
       for (j=0; j<n_HIV; j++){
         for (i=0; i<n_age; i++){
-          S_A[i][j][l] = y[ij];
-          Lsn_A[i][j][l] = y[ij+(n_age*n_ART*n_HIV)];
-          Lsp_A[i][j][l] = y[ij+(2*n_age*n_ART*n_HIV)];
-          Lmn_A[i][j][l] = y[ij+(3*n_age*n_ART*n_HIV)];
-          Lmp_A[i][j][l] = y[ij+(4*n_age*n_ART*n_HIV)];  
-          Nsn_A[i][j][l] = y[ij+(5*n_age*n_ART*n_HIV)];
-          Nsp_A[i][j][l] = y[ij+(6*n_age*n_ART*n_HIV)];
-          Nmn_A[i][j][l] = y[ij+(7*n_age*n_ART*n_HIV)];
-          Nmp_A[i][j][l] = y[ij+(8*n_age*n_ART*n_HIV)];
-          Isn_A[i][j][l] = y[ij+(9*n_age*n_ART*n_HIV)];
-          Isp_A[i][j][l] = y[ij+(10*n_age*n_ART*n_HIV)];
-          Imn_A[i][j][l] = y[ij+(11*n_age*n_ART*n_HIV)];
-          Imp_A[i][j][l] = y[ij+(12*n_age*n_ART*n_HIV)];
-          PTn_A[i][j][l] = y[ij+(13*n_age*n_ART*n_HIV)];
-          PTp_A[i][j][l] = y[ij+(14*n_age*n_ART*n_HIV)];
+          for (k=0; k<15; k++){
+            if (slot[k]>=0) X_A[k][i][j][l] = y[ij+(slot[k]*n_age*n_ART*n_HIV)];
+          }
           ij = ij+1;
         }
       }
@@ -429,12 +697,12 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
     /* Adjust TB model parameters for age, HIV and ART */
 
     /* Create vectors of disease parameters (by age - now single year bins) to use in derivatives - includes BCG effect on risk of primary disease */
-    double a_age[81];
-    double sig_age[81];
-    double v_age[81];
-    double muN_age[81];
-    double muI_age[81];
-    double bcg = (BCG_cov*(1-BCG_eff)+(1-BCG_cov));  /* those on bcg (BCG_COV) have RR of (1-BCG_eff) */
+    tb_real a_age[81];
+    tb_real sig_age[81];
+    tb_real v_age[81];
+    tb_real muN_age[81];
+    tb_real muI_age[81];
+    tb_real bcg = (BCG_cov*(1-BCG_eff)+(1-BCG_cov));  /* those on bcg (BCG_COV) have RR of (1-BCG_eff) */
 
     for (i=0; i<5; i++){
       a_age[i] = a0*bcg;
@@ -468,31 +736,31 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
     /* Now adjust parameters for HIV and ART */
     /* HIV mortality rates are passed in directly and ART mortality reduction is implemented in the derivatives */
 
-    double mid_CD4[7] = {500,425,300,225,150,75,25};       /* mid points of CD4 categories */
-    double ART_TB[3] = {ART_TB1,ART_TB2,ART_TB3};          /* vector of ART relative risks for TB disease */
-    double ART_mort[3] = {ART_mort1,ART_mort2,ART_mort3};  /* vector of ART relative risks for TB mortlaity */
+    tb_real mid_CD4[7] = {500,425,300,225,150,75,25};       /* mid points of CD4 categories */
+    tb_real ART_TB[3] = {ART_TB1,ART_TB2,ART_TB3};          /* vector of ART relative risks for TB disease */
+    tb_real ART_mort[3] = {ART_mort1,ART_mort2,ART_mort3};  /* vector of ART relative risks for TB mortlaity */
     /* then adjust parameters */
-    double a_age_H[81][7];
-    double p_H[7];
-    double v_age_H[81][7];
-    double a_age_A[81][7][3];
-    double p_A[7][3];
-    double v_age_A[81][7][3];
-    double muN_H_A[81][3];
-    double muI_H_A[81][3];
+    tb_real a_age_H[81][7];
+    tb_real p_H[7];
+    tb_real v_age_H[81][7];
+    tb_real a_age_A[81][7][3];
+    tb_real p_A[7][3];
+    tb_real v_age_A[81][7][3];
+    tb_real muN_H_A[81][3];
+    tb_real muI_H_A[81][3];
     for (j=0; j<n_HIV; j++){
-      p_H[j] = p*RR1p*pow(RR2p,-1*(500-mid_CD4[j])/100);
+      p_H[j] = p*RR1p*tb_pow(RR2p,-1*(500-mid_CD4[j])/100);
       for (i=0; i<n_age; i++){
-        a_age_H[i][j] = fmin(a_age[i]*RR1a*pow(RR2a,(500-mid_CD4[j])/100),1); /* fmin ensures proportion developing active disease can't go above 1 - assume this cap is also applied in TIME */
-        v_age_H[i][j] = v_age[i]*RR1v*pow(RR2v,(500-mid_CD4[j])/100);
+        a_age_H[i][j] = tb_fmin(a_age[i]*RR1a*tb_pow(RR2a,(500-mid_CD4[j])/100),1); /* fmin ensures proportion developing active disease can't go above 1 - assume this cap is also applied in TIME */
+        v_age_H[i][j] = v_age[i]*RR1v*tb_pow(RR2v,(500-mid_CD4[j])/100);
         for (l=0; l<n_ART; l++){
-          a_age_A[i][j][l] = fmax(a_age_H[i][j]*(1-ART_TB[l]),a_age[i]);   /* fmax or fmin ensures being on ART can't be better than being HIV- */
-          v_age_A[i][j][l] = fmax(v_age_H[i][j]*(1-ART_TB[l]),v_age[i]);
+          a_age_A[i][j][l] = tb_fmax(a_age_H[i][j]*(1-ART_TB[l]),a_age[i]);   /* fmax or fmin ensures being on ART can't be better than being HIV- */
+          v_age_A[i][j][l] = tb_fmax(v_age_H[i][j]*(1-ART_TB[l]),v_age[i]);
           
-          p_A[j][l] = fmin(1-(1-p_H[j])*(1-ART_TB[l]),p);                        /* protection term gets higher as ART is taken */
+          p_A[j][l] = tb_fmin(1-(1-p_H[j])*(1-ART_TB[l]),p);                        /* protection term gets higher as ART is taken */
 
-          muN_H_A[i][l] = fmax(muN_H*(1-ART_mort[l]),muN_age[i]); /* make sure mortality can't go lower than HIV- */ 
-          muI_H_A[i][l] = fmax(muI_H*(1-ART_mort[l]),muI_age[i]);
+          muN_H_A[i][l] = tb_fmax(muN_H*(1-ART_mort[l]),muN_age[i]); /* make sure mortality can't go lower than HIV- */ 
+          muI_H_A[i][l] = tb_fmax(muI_H*(1-ART_mort[l]),muI_age[i]);
         
         }
       }
@@ -500,7 +768,7 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
   
     /* Set up parameters for HIV model - these are taken from AIM */
 
-    double H_CD4[7][81] = {{0},{0},{0},{0},{0},{0},{0}}; /* Distribution of new HIV infections (age,CD4) - assume distribution of new child infections mirrors adults */
+    tb_real H_CD4[7][81] = {{0},{0},{0},{0},{0},{0},{0}}; /* Distribution of new HIV infections (age,CD4) - assume distribution of new child infections mirrors adults */
     for (i=0; i<25; i++) {
       H_CD4[0][i] = 0.643; H_CD4[1][i] = 0.357;
     }
@@ -516,7 +784,7 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
 
     /* Have updated these values based on the durations in the AIM manual (rate = 1/duration) as they are different from rates in AIM editor in software */
     /* those are actually risks (i.e. 1-exp(-rate)) */
-    double H_prog[8][81] = {{0},{0},{0},{0},{0},{0},{0},{0}};  /* Progression through CD4 categories (age, CD4) - has extra row to avoid progression in/out of first/last groups */
+    tb_real H_prog[8][81] = {{0},{0},{0},{0},{0},{0},{0},{0}};  /* Progression through CD4 categories (age, CD4) - has extra row to avoid progression in/out of first/last groups */
     for (i=0; i<15; i++){
       H_prog[1][i] = 0.298; H_prog[2][i] = 0.239; H_prog[3][i] = 0.183; H_prog[4][i] = 0.183; H_prog[5][i] = 0.130; H_prog[6][i] = 0.130;
     }
@@ -533,7 +801,7 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
       H_prog[1][i] = 0.213; H_prog[2][i] = 0.535; H_prog[3][i] = 0.855; H_prog[4][i] = 1.818; H_prog[5][i] = 0.952; H_prog[6][i] = 2.000;
     }
 
-    double H_mort[7][81]; /* Mortality due to HIV (no ART) (age, CD4) */
+    tb_real H_mort[7][81]; /* Mortality due to HIV (no ART) (age, CD4) */
     for (i=0; i<5; i++){
       H_mort[0][i] = 0.312; H_mort[1][i] = 0.382; H_mort[2][i] = 0.466; H_mort[3][i] = 0.466; H_mort[4][i] = 0.569; H_mort[5][i] = 0.569; H_mort[6][i] = 0.569;
     }
@@ -553,7 +821,7 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
       H_mort[0][i] = 0.005; H_mort[1][i] = 0.013; H_mort[2][i] = 0.032; H_mort[3][i] = 0.080; H_mort[4][i] = 0.203; H_mort[5][i] = 0.513; H_mort[6][i] = 1.295;
     } 
 
-    double A_mort[3][7][81]; /* On ART mortality (age,starting CD4, time on ART)  - this is an average of male and female values weigthed by sex of those on ART  */
+    tb_real A_mort[3][7][81]; /* On ART mortality (age,starting CD4, time on ART)  - this is an average of male and female values weigthed by sex of those on ART  */
         
     int kl;    
     for (i=0; i<5; i++){
@@ -563,28 +831,30 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
           for (kl=0; kl<16; kl++){
             A_mort[l][j][i + (kl*5)] = parms[kkk + (kl*21)];   
           }
+          /* 80+ is the 17th age group in the ART mortality rates */
+          if (i==0) A_mort[l][j][80] = parms[kkk + (16*21)];
           kkk++;
         }    
       }
     }
     
-    double A_prog[4] = {0,2,2,0}; /* Progression through time on ART, 6 monthly time blocks - 0 ensure no progression into first catergory and no progression out of last category*/
-    double A_start[3] = {1,0,0};  /* Used to make sure ART initiations are only added to the fist time on ART box */ 
+    tb_real A_prog[4] = {0,2,2,0}; /* Progression through time on ART, 6 monthly time blocks - 0 ensure no progression into first catergory and no progression out of last category*/
+    tb_real A_start[3] = {1,0,0};  /* Used to make sure ART initiations are only added to the fist time on ART box */ 
     
     /* sum up various totals */
 
     /* Use sumsum function to add up HIV- */
-    double Total_S = sumsum(S,0,80);                        /* Total susceptible */
-    double Total_Ls = sumsum(Lsn,0,80)+sumsum(Lsp,0,80);    /* Total LTBI with drug susceptible (DS) strain */
-    double Total_Lm = sumsum(Lmn,0,80)+sumsum(Lmp,0,80);    /* Total LTBI with drug resistant (DR) strain */
-    double Total_Ns_N = sumsum(Nsn,0,80)+sumsum(Nsp,0,80);    /* Total DS smear negative TB */
-    double Total_Nm_N = sumsum(Nmn,0,80)+sumsum(Nmp,0,80);    /* Total DR smear negative TB */
-    double Total_Is_N = sumsum(Isn,0,80)+sumsum(Isp,0,80);    /* Total DS smear positive TB */
-    double Total_Im_N = sumsum(Imn,0,80)+sumsum(Imp,0,80);    /* Total DR smear positive TB */
-    double Total_PT = sumsum(PTn,0,80)+sumsum(PTp,0,80);      /* Post PT */
+    tb_acc Total_S = tb_sumsum(S,0,80);                        /* Total susceptible */
+    tb_acc Total_Ls = tb_sumsum(Lsn,0,80)+tb_sumsum(Lsp,0,80);    /* Total LTBI with drug susceptible (DS) strain */
+    tb_acc Total_Lm = tb_sumsum(Lmn,0,80)+tb_sumsum(Lmp,0,80);    /* Total LTBI with drug resistant (DR) strain */
+    tb_acc Total_Ns_N = tb_sumsum(Nsn,0,80)+tb_sumsum(Nsp,0,80);    /* Total DS smear negative TB */
+    tb_acc Total_Nm_N = tb_sumsum(Nmn,0,80)+tb_sumsum(Nmp,0,80);    /* Total DR smear negative TB */
+    tb_acc Total_Is_N = tb_sumsum(Isn,0,80)+tb_sumsum(Isp,0,80);    /* Total DS smear positive TB */
+    tb_acc Total_Im_N = tb_sumsum(Imn,0,80)+tb_sumsum(Imp,0,80);    /* Total DR smear positive TB */
+    tb_acc Total_PT = tb_sumsum(PTn,0,80)+tb_sumsum(PTp,0,80);      /* Post PT */
     
     /* Now loop through HIV and ART and add them in */
-    double Total_Ns_H =0; double Total_Nm_H = 0; double Total_Is_H = 0; double Total_Im_H =0;
+    tb_acc Total_Ns_H =0; tb_acc Total_Nm_H = 0; tb_acc Total_Is_H = 0; tb_acc Total_Im_H =0;
     
     for (j=0; j<n_HIV; j++){
       for (i=0; i<n_age; i++){
@@ -608,53 +878,54 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
         }
       }
     }
-    double Total_L = Total_Ls + Total_Lm;           /* Total LTBI */
-    double Total_N_N = Total_Ns_N + Total_Nm_N;     /* Total smear negative TB (HIV-) */
-    double Total_N_H = Total_Ns_H + Total_Nm_H;     /* Total smear negative TB (HIV+) */
-    double Total_N = Total_N_N + Total_N_H;         /* Total smear negative TB */
-    double Total_I_N = Total_Is_N + Total_Im_N;     /* Total smear positive TB (HIV-) */
-    double Total_I_H = Total_Is_H + Total_Im_H;     /* Total smear positive TB (HIV+) */
-    double Total_I = Total_I_N + Total_I_H;         /* Total smear positive TB */
+    tb_acc Total_L = Total_Ls + Total_Lm;           /* Total LTBI */
+    tb_acc Total_N_N = Total_Ns_N + Total_Nm_N;     /* Total smear negative TB (HIV-) */
+    tb_acc Total_N_H = Total_Ns_H + Total_Nm_H;     /* Total smear negative TB (HIV+) */
+    tb_acc Total_N = Total_N_N + Total_N_H;         /* Total smear negative TB */
+    tb_acc Total_I_N = Total_Is_N + Total_Im_N;     /* Total smear positive TB (HIV-) */
+    tb_acc Total_I_H = Total_Is_H + Total_Im_H;     /* Total smear positive TB (HIV+) */
+    tb_acc Total_I = Total_I_N + Total_I_H;         /* Total smear positive TB */
     
-    double Total_DS = Total_Ns_N + Total_Ns_H + Total_Is_N + Total_Is_H;    /* Total DS TB */
-    double Total_MDR = Total_Nm_N + Total_Nm_H + Total_Im_N + Total_Im_H;   /* Total DR TB */
-    double Total = Total_S+Total_L+Total_N+Total_I+Total_PT; /* Total */
+    tb_acc Total_DS = Total_Ns_N + Total_Ns_H + Total_Is_N + Total_Is_H;    /* Total DS TB */
+    tb_acc Total_MDR = Total_Nm_N + Total_Nm_H + Total_Im_N + Total_Im_H;   /* Total DR TB */
+    tb_acc Total = Total_S+Total_L+Total_N+Total_I+Total_PT; /* Total */
     
     /* Mortality calculations and adjustments */
     /* HIV mortality rates include TB deaths */
     /* Background mortality rates include HIV and TB deaths */
-    /* Need to make an adjustment to both HIV and background rates to avoid double counting */
+    /* Need to make an adjustment to both HIV and background rates to avoid tb_real counting */
     
     /* Calculate deaths due to disease (TB and HIV) by age, CD4 and ART */
     /* work out disease induced mortality rate if pre 2015 - if after 2015 just use 2015 value */
     /* and adjust background mortality rate accordingly */
     /* Calculate total population in the same loop and prevalence of TB in HIV- */
-    double TB_deaths_neg[81];
-    double TB_deaths_HIV[81][7];
-    double TB_deaths_ART[81][7][3];
-    double TB_deaths_HIV_age[81] = {0};
-    double TB_deaths_ART_age[81] = {0};
-    double TB_deaths[81];
+    tb_real TB_deaths_neg[81];
+    tb_real TB_deaths_HIV[81][7];
+    tb_real TB_deaths_ART[81][7][3];
+    tb_real TB_deaths_HIV_age[81] = {0};
+    tb_real TB_deaths_ART_age[81] = {0};
+    tb_real TB_deaths[81];
     
-    double HIV_deaths_HIV[81] = {0}; ;
-    double HIV_deaths_ART[81] = {0};
+    tb_real HIV_deaths_HIV[81] = {0}; ;
+    tb_real HIV_deaths_ART[81] = {0};
 
-    double up_H_mort[7][81];
-    double up_A_mort[3][7][81];
-    double m_b[81];
-    double rate_dis_death[81];
+    tb_real up_H_mort[7][81];
+    tb_real up_A_mort[3][7][81];
+    tb_real m_b[81];
+    tb_real rate_dis_death[81];
     
-    double tot_age[81] = {0};
-    double tot_age_HIV[81][7];
-    double tot_age_ART[81][7][3];
+    tb_acc tot_age[81] = {0};
+    tb_acc tot_age_HIV[81][7];
+    tb_acc tot_age_ART[81][7][3];
     
-    /*double Tot_deaths = 0;*/
-    double Tot_deaths_age[81];
-    double ART_deaths_age[81] = {0};
-    double Tot_deaths=0;
-    double tot_age_neg[81] = {0};
+    /*tb_real Tot_deaths = 0;*/
+    tb_real Tot_deaths_age[81];
+    tb_real ART_deaths_age[81] = {0};
+    tb_real Tot_deaths=0;
+    tb_acc tot_age_neg[81] = {0};
     
  
+    TB_OMP_FOR(private(j,l) schedule(static))
     for (i=0; i<n_age; i++) {
       
       /* Calculate HIV- TB deaths */
@@ -675,8 +946,8 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
         /* Update size of age group */
         tot_age[i] = tot_age[i] + tot_age_HIV[i][j];
         /* Adjust HIV mortality probability to remove TB deaths (only if there is any HIV yet (otherwise we get a divide by 0 error)) */
-        if (tot_age_HIV[i][j]>0.0){
-          up_H_mort[j][i] = fmax(0,(H_mort[j][i] - (TB_deaths_HIV[i][j]/tot_age_HIV[i][j])));
+        if (tb_re(tot_age_HIV[i][j])>0.0){
+          up_H_mort[j][i] = tb_fmax(0,(H_mort[j][i] - (TB_deaths_HIV[i][j]/tot_age_HIV[i][j])));
         }
         else{
           up_H_mort[j][i] = H_mort[j][i];
@@ -701,8 +972,8 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
           /* Update size of age group */
           tot_age[i] = tot_age[i] + tot_age_ART[i][j][l];
           /* Adjust ART mortality probability to remove TB deaths (only if there is any ART yet (otherwise we get a divide by 0 error)) */
-          if (tot_age_ART[i][j][l]>0.0){
-            up_A_mort[l][j][i] = fmax(0,A_mort[l][j][i] - (TB_deaths_ART[i][j][l]/tot_age_ART[i][j][l]));
+          if (tb_re(tot_age_ART[i][j][l])>0.0){
+            up_A_mort[l][j][i] = tb_fmax(0,A_mort[l][j][i] - (TB_deaths_ART[i][j][l]/tot_age_ART[i][j][l]));
           }
           else{
             up_A_mort[l][j][i] = A_mort[l][j][i];
@@ -722,11 +993,10 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
         }                               
       }
 
-      if (pop_ad>0) rate_dis_death[i] = (TB_deaths_neg[i]+TB_deaths_HIV_age[i]+TB_deaths_ART_age[i]+HIV_deaths_HIV[i]+HIV_deaths_ART[i])/tot_age[i];
-      m_b[i] = fmax(0,forc[i+1]-rate_dis_death[i]);
+      if (tb_re(pop_ad)>0) rate_dis_death[i] = (TB_deaths_neg[i]+TB_deaths_HIV_age[i]+TB_deaths_ART_age[i]+HIV_deaths_HIV[i]+HIV_deaths_ART[i])/tot_age[i];
+      m_b[i] = tb_fmax(0,forc[i+1]-rate_dis_death[i]);
       
       Tot_deaths_age[i] = m_b[i]*tot_age[i] + TB_deaths[i] + HIV_deaths_HIV[i] + HIV_deaths_ART[i];  
-      Tot_deaths = Tot_deaths + Tot_deaths_age[i];
       
       /* Add in background deaths on ART - used to calculate new people to put on ART */
       for(j=0; j<n_HIV; j++){
@@ -737,24 +1007,28 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
       }
       
     } 
-    double TB_deaths_tot = sumsum(TB_deaths,0,80);
-    double TB_deaths_neg_tot = sumsum(TB_deaths_neg,0,80);
-    double TB_deaths_pos_tot = sumsum(TB_deaths_HIV_age,0,80) + sumsum(TB_deaths_ART_age,0,80);
+    for (i=0; i<n_age; i++) Tot_deaths = Tot_deaths + Tot_deaths_age[i];
+    tb_real TB_deaths_tot = tb_sumsum(TB_deaths,0,80);
+    tb_real TB_deaths_neg_tot = tb_sumsum(TB_deaths_neg,0,80);
+    tb_real TB_deaths_pos_tot = tb_sumsum(TB_deaths_HIV_age,0,80) + tb_sumsum(TB_deaths_ART_age,0,80);
     
     /* Sum up populations over CD4 categories, with and without ART and calculate rates of ART initiation by age */
     
-    double ART_prop[81][7] = {{0}};     /* Proportion of CD4 category who should start ART by age */
-    double CD4_dist[81][7] = {{0}};     /* Not on ART by CD4 and age */
-    double CD4_dist_ART[81][7] = {{0}}; /* On ART by CD4 and age*/
-    double CD4_dist_all[7] = {0};       /* Not on ART by CD4 */
-    double CD4_dist_ART_all[7] = {0};   /* On ART by CD4 */
-    double CD4_deaths[81][7] = {{0}};   /* Deaths by CD4 (no ART) */
-    double ART_new[81] = {0};           /* Number of new people to put on ART by age */
-    double ART_el[81] = {0};            /* Number who are eligible but not on ART */
-    double ART_el_deaths[81] = {0};     /* Number eligible who will die */
-    double ART_on[81] = {0};            /* Number who should be on ART by age */
-    double Tot_ART[81] = {0};           /* Number currently on ART by age */
+    tb_real ART_prop[81][7] = {{0}};     /* Proportion of CD4 category who should start ART by age */
+    tb_real CD4_dist[81][7] = {{0}};     /* Not on ART by CD4 and age */
+    tb_real CD4_dist_ART[81][7] = {{0}}; /* On ART by CD4 and age*/
+    tb_real CD4_dist_all[7] = {0};       /* Not on ART by CD4 */
+    tb_real CD4_dist_ART_all[7] = {0};   /* On ART by CD4 */
+    tb_real ART_new[81] = {0};           /* Number of new people to put on ART by age */
+    tb_real Tot_ART[81] = {0};           /* Number currently on ART by age */
     
+#if HIV_ON
+    /* Only needed if HIV is in the model - everything here stays zero otherwise */
+    tb_real CD4_deaths[81][7] = {{0}};   /* Deaths by CD4 (no ART) */
+    tb_real ART_el[81] = {0};            /* Number who are eligible but not on ART */
+    tb_real ART_el_deaths[81] = {0};     /* Number eligible who will die */
+    tb_real ART_on[81] = {0};            /* Number who should be on ART by age */
+    TB_OMP_FOR(private(j,l,iz) schedule(static))
     for (i=0; i<n_age; i++){
 
       iz = iii[i];
@@ -766,8 +1040,6 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
                          Isn_H[i][j]+Isp_H[i][j]+Imn_H[i][j]+Imp_H[i][j]+
                          PTn_H[i][j]+PTp_H[i][j];
                       
-        CD4_dist_all[j] = CD4_dist_all[j] + CD4_dist[i][j];
-        
         CD4_deaths[i][j] = H_mort[j][i]*(S_H[i][j]+Lsn_H[i][j]+Lsp_H[i][j]+Lmn_H[i][j]+Lmp_H[i][j]+
                                          Nsn_H[i][j]+Nsp_H[i][j]+Nmn_H[i][j]+Nmp_H[i][j]+ 
                                          Isn_H[i][j]+Isp_H[i][j]+Imn_H[i][j]+Imp_H[i][j]+
@@ -783,31 +1055,29 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
         
         } 
         
-        CD4_dist_ART_all[j] = CD4_dist_ART_all[j] + CD4_dist_ART[i][j];
-        
         Tot_ART[i] = Tot_ART[i] + CD4_dist_ART[i][j];  /* sum up number currently on ART */
          
 
          
-        if (j>=Athresh) { /* If this CD4 is eligible for ART */
+        if (j>=tb_re(Athresh)) { /* If this CD4 is eligible for ART */
           ART_on[i] = ART_on[i] + (CD4_dist[i][j] + CD4_dist_ART[i][j])*forc[iz+146]; /* number who should be on ART - HIV+ population times coverage (by CD4) */
         }
 
       }
-      ART_new[i] = fmax(0,ART_on[i] - (Tot_ART[i] - ART_deaths_age[i]));   /* number who need to start is number who should be on minus those already on plus those on ART who will die in current time */ 
+      ART_new[i] = tb_fmax(0,ART_on[i] - (Tot_ART[i] - ART_deaths_age[i]));   /* number who need to start is number who should be on minus those already on plus those on ART who will die in current time */ 
         
       /* Then work out where these should go by CD4 - based on proportion of eligible population in CD4 group and proportion of deaths which occur in CD4 group */
-      for (j=Athresh; j<n_HIV; j++) {
+      for (j=tb_re(Athresh); j<n_HIV; j++) {
         ART_el[i] = ART_el[i] + CD4_dist[i][j];
         ART_el_deaths[i] = ART_el_deaths[i] + CD4_deaths[i][j];
       }
       
       /* check that number to be put on isn't greater than number eligbile */
-      ART_new[i] = fmin(ART_el[i],ART_new[i]);
+      ART_new[i] = tb_fmin(ART_el[i],ART_new[i]);
       
-      if (ART_el[i] > 0){
-        for (j=Athresh; j<n_HIV; j++) {
-          if (CD4_dist[i][j] > 0) {
+      if (tb_re(ART_el[i]) > 0){
+        for (j=tb_re(Athresh); j<n_HIV; j++) {
+          if (tb_re(CD4_dist[i][j]) > 0) {
             
             ART_prop[i][j] = (((CD4_dist[i][j]/ART_el[i])+(CD4_deaths[i][j]/ART_el_deaths[i]))/2)*(ART_new[i]/CD4_dist[i][j]); /* applies weighting and size of CD4 group to work out % of CD4 group that should move */
             
@@ -815,272 +1085,335 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
         }
       }
     }
+#endif
 
-    /* Total on or starting ART - if zero use it to skip running ART derivs */
-    double ART_all = sumsum(Tot_ART,0,80) + sumsum(ART_new,0,80);
+    for (i=0; i<n_age; i++){
+      for (j=0; j<n_HIV; j++){
+        CD4_dist_all[j] = CD4_dist_all[j] + CD4_dist[i][j];
+        CD4_dist_ART_all[j] = CD4_dist_ART_all[j] + CD4_dist_ART[i][j];
+      }
+    }
 
-    /* Force of infection */
-    double FS = beta*(Total_Ns_N*rel_inf + Total_Ns_H*rel_inf_H + Total_Is_N + Total_Is_H)/Total; 
-    double FM = fit_cost*beta*(Total_Nm_N*rel_inf + Total_Nm_H*rel_inf_H + Total_Im_N + Total_Im_H)/Total; 
+    /* Total on or starting ART - if zero use it to skip running ART derivs */
+    tb_real ART_all = tb_sumsum(Tot_ART,0,80) + tb_sumsum(ART_new,0,80);
+
+    /* Force of infection - the same at every age unless there is a contact matrix (see AGE MIXING above) */
+    /* FS_all and FM_all are the averages over the whole population (outputs FS and FM) */
+    tb_acc FS_all = beta*(Total_Ns_N*rel_inf + Total_Ns_H*rel_inf_H + Total_Is_N + Total_Is_H)/Total; 
+    tb_acc FM_all = fit_cost*beta*(Total_Nm_N*rel_inf + Total_Nm_H*rel_inf_H + Total_Im_N + Total_Im_H)/Total; 
+    if (mix!=NULL){
+      FS_all = mix[162];
+      FM_all = mix[163];
+    }
+    tb_acc FS_age[81];
+    tb_acc FM_age[81];
+    if (tb_contact){
+      tb_real xs[81], xm[81];
+      if (mix!=NULL){
+        for (i=0; i<n_age; i++){
+          xs[i] = mix[i];
+          xm[i] = mix[81+i];
+        }
+      }
+      else {
+        for (i=0; i<n_age; i++){
+          tb_real Ns_H = 0, Nm_H = 0, Is_H = 0, Im_H = 0;
+          for (j=0; j<n_HIV; j++){
+            Ns_H = Ns_H + Nsn_H[i][j]+Nsp_H[i][j];
+            Nm_H = Nm_H + Nmn_H[i][j]+Nmp_H[i][j];
+            Is_H = Is_H + Isn_H[i][j]+Isp_H[i][j];
+            Im_H = Im_H + Imn_H[i][j]+Imp_H[i][j];
+            for (l=0; l<n_ART; l++){
+              Ns_H = Ns_H + Nsn_A[i][j][l]+Nsp_A[i][j][l];
+              Nm_H = Nm_H + Nmn_A[i][j][l]+Nmp_A[i][j][l];
+              Is_H = Is_H + Isn_A[i][j][l]+Isp_A[i][j][l];
+              Im_H = Im_H + Imn_A[i][j][l]+Imp_A[i][j][l];
+            }
+          }
+          xs[i] = xm[i] = 0;
+          if (tb_re(tot_age[i])>0.0){
+            xs[i] = beta*((Nsn[i]+Nsp[i])*rel_inf + Ns_H*rel_inf_H + Isn[i]+Isp[i] + Is_H)/tot_age[i];
+            xm[i] = fit_cost*beta*((Nmn[i]+Nmp[i])*rel_inf + Nm_H*rel_inf_H + Imn[i]+Imp[i] + Im_H)/tot_age[i];
+          }
+        }
+      }
+      contact_foi(xs,xm,FS_age,FM_age);
+      FS_all = FM_all = 0;
+      for (i=0; i<n_age; i++){
+        FS_all = FS_all + FS_age[i]*tot_age[i]/Total;
+        FM_all = FM_all + FM_age[i]*tot_age[i]/Total;
+      }
+    }
+    else {
+      for (i=0; i<n_age; i++){
+        FS_age[i] = FS_all;
+        FM_age[i] = FM_all;
+      }
+    }
     
     /* Variables to store numbers of new cases */
-    double TB_cases_age[81] = {0};
-    double TB_cases_neg_age[81];
-    double TB_cases_neg = 0;
-    double TB_cases_pos_age[81][7];
-    double TB_cases_pos = 0;
-    double TB_cases_ART_age[81][7][3];
-    double TB_cases_ART = 0;
+    tb_real TB_cases_age[81] = {0};
+    tb_real TB_cases_neg_age[81];
+    tb_real TB_cases_neg = 0;
+    tb_real TB_cases_pos_age[81][7];
+    tb_real TB_cases_pos = 0;
+    tb_real TB_cases_ART_age[81][7][3];
+    tb_real TB_cases_ART = 0;
         
     /* Derivatives */ 
  
     /* HIV-: loop through ages*/ 
     
-    double births = birth_rate*Total/1000;
+    tb_real births = birth_rate*Total/1000;
 
+    TB_OMP_FOR(private(j,l,iz) schedule(static))
     for (i=0; i<n_age; i++){
       
       iz = iii[i];
       
+      tb_real HIV_inc = HIV_ON*forc[iz+82];  /* HIV incidence at this age (none if HIV is left out) */
+      tb_acc FS = FS_age[i];                 /* Force of infection at this age */
+      tb_acc FM = FM_age[i];
+      
       /* Calculate the disease flows here and use these in the derivatives - intention is to make the model more flexible/easier to understand */
       
-      double S_to_Lsn = FS*(1-a_age[i])*S[i];                                     /* Susceptible to latent DS infection (no disease history) */
-      double S_to_Nsn = FS*a_age[i]*(1-sig_age[i])*S[i];                          /* Susceptible to primary DS smear negative disease (no disease history) */
-      double S_to_Isn = FS*a_age[i]*sig_age[i]*S[i];                              /* Susceptible to primary DS smear positive disease (no disease history) */
-      double S_to_Lmn = FM*(1-a_age[i])*S[i];                                     /* Susceptible to latent DR infection (no disease history) */
-      double S_to_Nmn = FM*a_age[i]*(1-sig_age[i])*S[i];                          /* Susceptible to primary DR smear negative disease (no disease history) */
-      double S_to_Imn = FM*a_age[i]*sig_age[i]*S[i];                              /* Susceptible to primary DR smear positive disease (no disease history) */
+      tb_real S_to_Lsn = FS*(1-a_age[i])*S[i];                                     /* Susceptible to latent DS infection (no disease history) */
+      tb_real S_to_Nsn = FS*a_age[i]*(1-sig_age[i])*S[i];                          /* Susceptible to primary DS smear negative disease (no disease history) */
+      tb_real S_to_Isn = FS*a_age[i]*sig_age[i]*S[i];                              /* Susceptible to primary DS smear positive disease (no disease history) */
+      tb_real S_to_Lmn = FM*(1-a_age[i])*S[i];                                     /* Susceptible to latent DR infection (no disease history) */
+      tb_real S_to_Nmn = FM*a_age[i]*(1-sig_age[i])*S[i];                          /* Susceptible to primary DR smear negative disease (no disease history) */
+      tb_real S_to_Imn = FM*a_age[i]*sig_age[i]*S[i];                              /* Susceptible to primary DR smear positive disease (no disease history) */
       
-      double Lsn_to_Nsn = (v_age[i] + FS*a_age[i]*(1-p))*(1-sig_age[i])*Lsn[i];   /* Latent DS to smear negative DS disease (no disease history) - reactivation and reinfection */ 
-      double Lsn_to_Isn = (v_age[i] + FS*a_age[i]*(1-p))*sig_age[i]*Lsn[i];       /* Latent DS to smear positive DS disease (no disease history) - reactivation and reinfection */ 
-      double Lsn_to_Nmn = FM*a_age[i]*(1-p)*(1-sig_age[i])*Lsn[i];                /* Latent DS to smear negative DR disease (no disease history) - co-infection */ 
-      double Lsn_to_Imn = FM*a_age[i]*(1-p)*sig_age[i]*Lsn[i];                    /* Latent DS to smear positive DR disease (no disease history) - co-infection */
-      double Lsn_to_Lmn = FM*(1-a_age[i])*(1-p)*g*Lsn[i];                         /* Latent DS to latent DR (no disease history) */
+      tb_real Lsn_to_Nsn = (v_age[i] + FS*a_age[i]*(1-p))*(1-sig_age[i])*Lsn[i];   /* Latent DS to smear negative DS disease (no disease history) - reactivation and reinfection */ 
+      tb_real Lsn_to_Isn = (v_age[i] + FS*a_age[i]*(1-p))*sig_age[i]*Lsn[i];       /* Latent DS to smear positive DS disease (no disease history) - reactivation and reinfection */ 
+      tb_real Lsn_to_Nmn = FM*a_age[i]*(1-p)*(1-sig_age[i])*Lsn[i];                /* Latent DS to smear negative DR disease (no disease history) - co-infection */ 
+      tb_real Lsn_to_Imn = FM*a_age[i]*(1-p)*sig_age[i]*Lsn[i];                    /* Latent DS to smear positive DR disease (no disease history) - co-infection */
+      tb_real Lsn_to_Lmn = FM*(1-a_age[i])*(1-p)*g*Lsn[i];                         /* Latent DS to latent DR (no disease history) */
       
-      double Lmn_to_Nmn = (v_age[i] + FM*a_age[i]*(1-p))*(1-sig_age[i])*Lmn[i];   /* Latent DR to smear negative DR disease (no disease history) - reactivation and reinfection */ 
-      double Lmn_to_Imn = (v_age[i] + FM*a_age[i]*(1-p))*sig_age[i]*Lmn[i];       /* Latent DR to smear positive DR disease (no disease history) - reactivation and reinfection */ 
-      double Lmn_to_Nsn = FS*a_age[i]*(1-sig_age[i])*(1-p)*Lmn[i];                /* Latent DR to smear negative DS disease (no disease history) - co-infection */
-      double Lmn_to_Isn = FS*a_age[i]*sig_age[i]*(1-p)*Lmn[i];                    /* Latent DR to smear positive DS disease (no disease history) - co-infection */
-      double Lmn_to_Lsn = FS*(1-a_age[i])*(1-p)*(1-g)*Lmn[i];                     /* Latent DR to latent DS (no disease history) */
-
-      double Lsp_to_Nsp = (v_age[i] + FS*a_age[i]*(1-p))*(1-sig_age[i])*Lsp[i];   /* Latent DS to smear negative DS disease (prior Rx) - reactivation and reinfection */ 
-      double Lsp_to_Isp = (v_age[i] + FS*a_age[i]*(1-p))*sig_age[i]*Lsp[i];       /* Latent DS to smear positive DS disease (prior Rx) - reactivation and reinfection */     
-      double Lsp_to_Nmp = FM*a_age[i]*(1-p)*(1-sig_age[i])*Lsp[i];                /* Latent DS to smear negative DR disease (prior_rx) - reactivation and reinfection */ 
-      double Lsp_to_Imp = FM*a_age[i]*(1-p)*sig_age[i]*Lsp[i];                    /* Latent DS to smear positive DR disease (prior_Rx) - reactivation and reinfection */
-      double Lsp_to_Lmp = FM*(1-a_age[i])*(1-p)*g*Lsp[i];                         /* Latent DS to latent DR (prior Rx) */
+      tb_real Lmn_to_Nmn = (v_age[i] + FM*a_age[i]*(1-p))*(1-sig_age[i])*Lmn[i];   /* Latent DR to smear negative DR disease (no disease history) - reactivation and reinfection */ 
+      tb_real Lmn_to_Imn = (v_age[i] + FM*a_age[i]*(1-p))*sig_age[i]*Lmn[i];       /* Latent DR to smear positive DR disease (no disease history) - reactivation and reinfection */ 
+      tb_real Lmn_to_Nsn = FS*a_age[i]*(1-sig_age[i])*(1-p)*Lmn[i];                /* Latent DR to smear negative DS disease (no disease history) - co-infection */
+      tb_real Lmn_to_Isn = FS*a_age[i]*sig_age[i]*(1-p)*Lmn[i];                    /* Latent DR to smear positive DS disease (no disease history) - co-infection */
+      tb_real Lmn_to_Lsn = FS*(1-a_age[i])*(1-p)*(1-g)*Lmn[i];                     /* Latent DR to latent DS (no disease history) */
+
+      tb_real Lsp_to_Nsp = (v_age[i] + FS*a_age[i]*(1-p))*(1-sig_age[i])*Lsp[i];   /* Latent DS to smear negative DS disease (prior Rx) - reactivation and reinfection */ 
+      tb_real Lsp_to_Isp = (v_age[i] + FS*a_age[i]*(1-p))*sig_age[i]*Lsp[i];       /* Latent DS to smear positive DS disease (prior Rx) - reactivation and reinfection */     
+      tb_real Lsp_to_Nmp = FM*a_age[i]*(1-p)*(1-sig_age[i])*Lsp[i];                /* Latent DS to smear negative DR disease (prior_rx) - reactivation and reinfection */ 
+      tb_real Lsp_to_Imp = FM*a_age[i]*(1-p)*sig_age[i]*Lsp[i];                    /* Latent DS to smear positive DR disease (prior_Rx) - reactivation and reinfection */
+      tb_real Lsp_to_Lmp = FM*(1-a_age[i])*(1-p)*g*Lsp[i];                         /* Latent DS to latent DR (prior Rx) */
       
-      double Lmp_to_Nmp = (v_age[i] + FM*a_age[i]*(1-p))*(1-sig_age[i])*Lmp[i];   /* Latent DR to smear negative DR disease (prior Rx) - reactivation and reinfection */ 
-      double Lmp_to_Imp = (v_age[i] + FM*a_age[i]*(1-p))*sig_age[i]*Lmp[i];       /* Latent DR to smear positive DR disease (prior Rx) - reactivation and reinfection */     
-      double Lmp_to_Nsp = FS*a_age[i]*(1-p)*(1-sig_age[i])*Lmp[i];                /* Latent DR to smear negative DS disease (prior_rx) - reactivation and reinfection */ 
-      double Lmp_to_Isp = FS*a_age[i]*(1-p)*sig_age[i]*Lmp[i];                    /* Latent DR to smear positive DS disease (prior_Rx) - reactivation and reinfection */
-      double Lmp_to_Lsp = FS*(1-a_age[i])*(1-p)*(1-g)*Lmp[i];                     /* Latent DR to latent DS (prior Rx) */
+      tb_real Lmp_to_Nmp = (v_age[i] + FM*a_age[i]*(1-p))*(1-sig_age[i])*Lmp[i];   /* Latent DR to smear negative DR disease (prior Rx) - reactivation and reinfection */ 
+      tb_real Lmp_to_Imp = (v_age[i] + FM*a_age[i]*(1-p))*sig_age[i]*Lmp[i];       /* Latent DR to smear positive DR disease (prior Rx) - reactivation and reinfection */     
+      tb_real Lmp_to_Nsp = FS*a_age[i]*(1-p)*(1-sig_age[i])*Lmp[i];                /* Latent DR to smear negative DS disease (prior_rx) - reactivation and reinfection */ 
+      tb_real Lmp_to_Isp = FS*a_age[i]*(1-p)*sig_age[i]*Lmp[i];                    /* Latent DR to smear positive DS disease (prior_Rx) - reactivation and reinfection */
+      tb_real Lmp_to_Lsp = FS*(1-a_age[i])*(1-p)*(1-g)*Lmp[i];                     /* Latent DR to latent DS (prior Rx) */
       
-      double PTn_to_Lsn = FS*(1-a_age[i])*(1-p)*PTn[i];                           /* Post PT to latent DS (no disease history) */
-      double PTn_to_Nsn = FS*a_age[i]*(1-p)*(1-sig_age[i])*PTn[i];                /* Post PT to smear negative DS disease (no disease history) */
-      double PTn_to_Isn = FS*a_age[i]*(1-p)*sig_age[i]*PTn[i];                    /* Post PT to smear positive DS disease (no disease history) */
-      double PTn_to_Lmn = FM*(1-a_age[i])*(1-p)*g*PTn[i];                         /* Post PT to latent DR (no disease history) */
-      double PTn_to_Nmn = FM*a_age[i]*(1-p)*(1-sig_age[i])*PTn[i];                /* Post PT to smear negative DR disease (no disease history) */
-      double PTn_to_Imn = FM*a_age[i]*(1-p)*sig_age[i]*PTn[i];                    /* Post PT to smear positive DR disease (no disease history) */
+      tb_real PTn_to_Lsn = FS*(1-a_age[i])*(1-p)*PTn[i];                           /* Post PT to latent DS (no disease history) */
+      tb_real PTn_to_Nsn = FS*a_age[i]*(1-p)*(1-sig_age[i])*PTn[i];                /* Post PT to smear negative DS disease (no disease history) */
+      tb_real PTn_to_Isn = FS*a_age[i]*(1-p)*sig_age[i]*PTn[i];                    /* Post PT to smear positive DS disease (no disease history) */
+      tb_real PTn_to_Lmn = FM*(1-a_age[i])*(1-p)*g*PTn[i];                         /* Post PT to latent DR (no disease history) */
+      tb_real PTn_to_Nmn = FM*a_age[i]*(1-p)*(1-sig_age[i])*PTn[i];                /* Post PT to smear negative DR disease (no disease history) */
+      tb_real PTn_to_Imn = FM*a_age[i]*(1-p)*sig_age[i]*PTn[i];                    /* Post PT to smear positive DR disease (no disease history) */
       
-      double PTp_to_Lsp = FS*(1-a_age[i])*(1-p)*PTp[i];                           /* Post PT to latent DS (prior Rx) */
-      double PTp_to_Nsp = FS*a_age[i]*(1-p)*(1-sig_age[i])*PTp[i];                /* Post PT to smear negative DS disease (prior Rx) */
-      double PTp_to_Isp = FS*a_age[i]*(1-p)*sig_age[i]*PTp[i];                    /* Post PT to smear positive DS disease (prior Rx) */
-      double PTp_to_Lmp = FM*(1-a_age[i])*(1-p)*g*PTp[i];                         /* Post PT to latent DR (prior Rx) */
-      double PTp_to_Nmp = FM*a_age[i]*(1-p)*(1-sig_age[i])*PTp[i];                /* Post PT to smear negative DR disease (prior Rx) */
-      double PTp_to_Imp = FM*a_age[i]*(1-p)*sig_age[i]*PTp[i];                    /* Post PT to smear positive DR disease (prior Rx) */
+      tb_real PTp_to_Lsp = FS*(1-a_age[i])*(1-p)*PTp[i];                           /* Post PT to latent DS (prior Rx) */
+      tb_real PTp_to_Nsp = FS*a_age[i]*(1-p)*(1-sig_age[i])*PTp[i];                /* Post PT to smear negative DS disease (prior Rx) */
+      tb_real PTp_to_Isp = FS*a_age[i]*(1-p)*sig_age[i]*PTp[i];                    /* Post PT to smear positive DS disease (prior Rx) */
+      tb_real PTp_to_Lmp = FM*(1-a_age[i])*(1-p)*g*PTp[i];                         /* Post PT to latent DR (prior Rx) */
+      tb_real PTp_to_Nmp = FM*a_age[i]*(1-p)*(1-sig_age[i])*PTp[i];                /* Post PT to smear negative DR disease (prior Rx) */
+      tb_real PTp_to_Imp = FM*a_age[i]*(1-p)*sig_age[i]*PTp[i];                    /* Post PT to smear positive DR disease (prior Rx) */
       
       /* Calculate "care" flows here and use these in the derivatives */
       
-      double false_pos = health*kneg*(1-sp_I_neg*sp_N_neg)*l_s;   /* Susceptible, latently infected and post-PT are false pos notif at this rate (includes link to Rx). */
+      tb_real false_pos = health*kneg*(1-sp_I_neg*sp_N_neg)*l_s;   /* Susceptible, latently infected and post-PT are false pos notif at this rate (includes link to Rx). */
                                                                   /* This only has any effect in those latently infected with drug sus strains. tneg_s complete Rx and move to PTn/PTp */
       /* sm-, drug sus, no Rx history */    
-      double Nsn_pos = kneg*se_N_neg*rel_d*Nsn[i];            /* TB positive - move all out of Nsn */
-      double Nsn_dst = Nsn_pos*dstneg_n;                      /* Get DST */
-      double Nsn_dst_fpos = Nsn_dst*(1-sp_m_neg);             /* False pos on DST */
-      double Nsn_first = l_s*(Nsn_pos - Nsn_dst_fpos);        /* Start first line Rx (correct) */     
-      double Nsn_second = l_m*(Nsn_dst_fpos);                 /* Start second line treatment (incorrect) */
-      double Nsn_lost = Nsn_pos - Nsn_first - Nsn_second;     /* Positive cases lost to follow up  - go to Nsn */ 
-      double Nsn_res = Nsn_first*e;                           /* Develop resistance - go to Nmp */
-      double Nsn_first_success = (Nsn_first-Nsn_res)*tneg_s;  /* First line success - go to Lsp */
-      double Nsn_first_fail = (Nsn_first-Nsn_res)*(1-tneg_s); /* First line failure - go to Nsp */
-      double Nsn_second_success = Nsn_second*tneg_m;          /* Second line success - go to Lsp */
-      double Nsn_second_fail = Nsn_second*(1-tneg_m);         /* Second line failure - go to Nsp */
+      tb_real Nsn_pos = kneg*se_N_neg*rel_d*Nsn[i];            /* TB positive - move all out of Nsn */
+      tb_real Nsn_dst = Nsn_pos*dstneg_n;                      /* Get DST */
+      tb_real Nsn_dst_fpos = Nsn_dst*(1-sp_m_neg);             /* False pos on DST */
+      tb_real Nsn_first = l_s*(Nsn_pos - Nsn_dst_fpos);        /* Start first line Rx (correct) */     
+      tb_real Nsn_second = l_m*(Nsn_dst_fpos);                 /* Start second line treatment (incorrect) */
+      tb_real Nsn_lost = Nsn_pos - Nsn_first - Nsn_second;     /* Positive cases lost to follow up  - go to Nsn */ 
+      tb_real Nsn_res = Nsn_first*e;                           /* Develop resistance - go to Nmp */
+      tb_real Nsn_first_success = (Nsn_first-Nsn_res)*tneg_s;  /* First line success - go to Lsp */
+      tb_real Nsn_first_fail = (Nsn_first-Nsn_res)*(1-tneg_s); /* First line failure - go to Nsp */
+      tb_real Nsn_second_success = Nsn_second*tneg_m;          /* Second line success - go to Lsp */
+      tb_real Nsn_second_fail = Nsn_second*(1-tneg_m);         /* Second line failure - go to Nsp */
 
       /* sm-, drug sus, previous Rx history */    
-      double Nsp_pos = kneg*se_N_neg*rel_d*Nsp[i];            /* TB positive - move all out of Nsp */
-      double Nsp_dst = Nsp_pos*dstneg_p;                      /* Get DST */
-      double Nsp_dst_fpos = Nsp_dst*(1-sp_m_neg);             /* False pos on DST */
-      double Nsp_first = l_s*(Nsp_pos - Nsp_dst_fpos);        /* Start first line Rx (correct) */     
-      double Nsp_second = l_m*(Nsp_dst_fpos);                 /* Start second line treatment (incorrect) */
-      double Nsp_lost = Nsp_pos - Nsp_first - Nsp_second;     /* Positive cases lost to follow up  - go to Nsp */ 
-      double Nsp_res = Nsp_first*e;                           /* Develop resistance - go to Nmp */
-      double Nsp_first_success = (Nsp_first-Nsp_res)*tneg_s;  /* First line success - go to Lsp */
-      double Nsp_first_fail = (Nsp_first-Nsp_res)*(1-tneg_s); /* First line failure - go to Nsp */
-      double Nsp_second_success = Nsp_second*tneg_m;          /* Second line success - go to Lsp */
-      double Nsp_second_fail = Nsp_second*(1-tneg_m);         /* Second line failure - go to Nsp */
+      tb_real Nsp_pos = kneg*se_N_neg*rel_d*Nsp[i];            /* TB positive - move all out of Nsp */
+      tb_real Nsp_dst = Nsp_pos*dstneg_p;                      /* Get DST */
+      tb_real Nsp_dst_fpos = Nsp_dst*(1-sp_m_neg);             /* False pos on DST */
+      tb_real Nsp_first = l_s*(Nsp_pos - Nsp_dst_fpos);        /* Start first line Rx (correct) */     
+      tb_real Nsp_second = l_m*(Nsp_dst_fpos);                 /* Start second line treatment (incorrect) */
+      tb_real Nsp_lost = Nsp_pos - Nsp_first - Nsp_second;     /* Positive cases lost to follow up  - go to Nsp */ 
+      tb_real Nsp_res = Nsp_first*e;                           /* Develop resistance - go to Nmp */
+      tb_real Nsp_first_success = (Nsp_first-Nsp_res)*tneg_s;  /* First line success - go to Lsp */
+      tb_real Nsp_first_fail = (Nsp_first-Nsp_res)*(1-tneg_s); /* First line failure - go to Nsp */
+      tb_real Nsp_second_success = Nsp_second*tneg_m;          /* Second line success - go to Lsp */
+      tb_real Nsp_second_fail = Nsp_second*(1-tneg_m);         /* Second line failure - go to Nsp */
 
       /* sm+, drug sus, no Rx history */    
-      double Isn_pos = kneg*se_I_neg*Isn[i];                  /* TB positive - move all out of Isn */
-      double Isn_dst = Isn_pos*dstneg_n;                      /* Get DST */
-      double Isn_dst_fpos = Isn_dst*(1-sp_m_neg);             /* False pos on DST */
-      double Isn_first = l_s*(Isn_pos - Isn_dst_fpos);        /* Start first line Rx (correct) */     
-      double Isn_second = l_m*(Isn_dst_fpos);                 /* Start second line treatment (incorrect) */
-      double Isn_lost = Isn_pos - Isn_first - Isn_second;     /* Positive cases lost to follow up  - go to Isn */ 
-      double Isn_res = Isn_first*e;                           /* Develop resistance - go to Imp */
-      double Isn_first_success = (Isn_first-Isn_res)*tneg_s;  /* First line success - go to Lsp */
-      double Isn_first_fail = (Isn_first-Isn_res)*(1-tneg_s); /* First line failure - go to Isp */
-      double Isn_second_success = Isn_second*tneg_m;          /* Second line success - go to Lsp */
-      double Isn_second_fail = Isn_second*(1-tneg_m);         /* Second line failure - go to Isp */
+      tb_real Isn_pos = kneg*se_I_neg*Isn[i];                  /* TB positive - move all out of Isn */
+      tb_real Isn_dst = Isn_pos*dstneg_n;                      /* Get DST */
+      tb_real Isn_dst_fpos = Isn_dst*(1-sp_m_neg);             /* False pos on DST */
+      tb_real Isn_first = l_s*(Isn_pos - Isn_dst_fpos);        /* Start first line Rx (correct) */     
+      tb_real Isn_second = l_m*(Isn_dst_fpos);                 /* Start second line treatment (incorrect) */
+      tb_real Isn_lost = Isn_pos - Isn_first - Isn_second;     /* Positive cases lost to follow up  - go to Isn */ 
+      tb_real Isn_res = Isn_first*e;                           /* Develop resistance - go to Imp */
+      tb_real Isn_first_success = (Isn_first-Isn_res)*tneg_s;  /* First line success - go to Lsp */
+      tb_real Isn_first_fail = (Isn_first-Isn_res)*(1-tneg_s); /* First line failure - go to Isp */
+      tb_real Isn_second_success = Isn_second*tneg_m;          /* Second line success - go to Lsp */
+      tb_real Isn_second_fail = Isn_second*(1-tneg_m);         /* Second line failure - go to Isp */
 
       /* sm+, drug sus, previous Rx history */    
-      double Isp_pos = kneg*se_I_neg*Isp[i];                  /* TB positive - move all out of Isp */
-      double Isp_dst = Isp_pos*dstneg_p;                      /* Get DST */
-      double Isp_dst_fpos = Isp_dst*(1-sp_m_neg);             /* False pos on DST */
-      double Isp_first = l_s*(Isp_pos - Isp_dst_fpos);        /* Start first line Rx (correct) */     
-      double Isp_second = l_m*(Isp_dst_fpos);                 /* Start second line Rx (incorrect) */
-      double Isp_lost = Isp_pos - Isp_first - Isp_second;     /* Positive cases lost to follow up  - go to Isp */ 
-      double Isp_res = Isp_first*e;                           /* Develop resistance - go to Imp */
-      double Isp_first_success = (Isp_first-Isp_res)*tneg_s;  /* First line success - go to Lsp */
-      double Isp_first_fail = (Isp_first-Isp_res)*(1-tneg_s); /* First line failure - go to Isp */
-      double Isp_second_success = Isp_second*tneg_m;          /* Second line success - go to Lsp */
-      double Isp_second_fail = Isp_second*(1-tneg_m);         /* Second line failure - go to Isp */
+      tb_real Isp_pos = kneg*se_I_neg*Isp[i];                  /* TB positive - move all out of Isp */
+      tb_real Isp_dst = Isp_pos*dstneg_p;                      /* Get DST */
+      tb_real Isp_dst_fpos = Isp_dst*(1-sp_m_neg);             /* False pos on DST */
+      tb_real Isp_first = l_s*(Isp_pos - Isp_dst_fpos);        /* Start first line Rx (correct) */     
+      tb_real Isp_second = l_m*(Isp_dst_fpos);                 /* Start second line Rx (incorrect) */
+      tb_real Isp_lost = Isp_pos - Isp_first - Isp_second;     /* Positive cases lost to follow up  - go to Isp */ 
+      tb_real Isp_res = Isp_first*e;                           /* Develop resistance - go to Imp */
+      tb_real Isp_first_success = (Isp_first-Isp_res)*tneg_s;  /* First line success - go to Lsp */
+      tb_real Isp_first_fail = (Isp_first-Isp_res)*(1-tneg_s); /* First line failure - go to Isp */
+      tb_real Isp_second_success = Isp_second*tneg_m;          /* Second line success - go to Lsp */
+      tb_real Isp_second_fail = Isp_second*(1-tneg_m);         /* Second line failure - go to Isp */
 
       /* sm-, MDR, no Rx history */
-      double Nmn_pos = kneg*se_N_neg*rel_d*Nmn[i];            /* TB positive - move all out of Nmn */
-      double Nmn_dst = Nmn_pos*dstneg_n;                      /* Get DST */
-      double Nmn_dst_pos = Nmn_dst*se_m_neg;                  /* True pos on DST */
-      double Nmn_first = l_s*(Nmn_pos - Nmn_dst_pos);         /* Start first line Rx (incorrect) */  
-      double Nmn_second = l_m*Nmn_dst_pos;                    /* Start second line Rx (correct) */
-      double Nmn_lost = Nmn_pos - Nmn_first - Nmn_second;     /* Positive cases lost to follow up - go to Nmn */
-      double Nmn_first_success = Nmn_first*tneg_s*eff_n;      /* First line success - go to Lmp */
-      double Nmn_first_fail = Nmn_first - Nmn_first_success;  /* First line failure - go to Nmp */
-      double Nmn_second_success = Nmn_second*tneg_m;          /* Second line success - go to Lmp */
-      double Nmn_second_fail = Nmn_second*(1-tneg_m);         /* Second line failure - go to Nmp */
+      tb_real Nmn_pos = kneg*se_N_neg*rel_d*Nmn[i];            /* TB positive - move all out of Nmn */
+      tb_real Nmn_dst = Nmn_pos*dstneg_n;                      /* Get DST */
+      tb_real Nmn_dst_pos = Nmn_dst*se_m_neg;                  /* True pos on DST */
+      tb_real Nmn_first = l_s*(Nmn_pos - Nmn_dst_pos);         /* Start first line Rx (incorrect) */  
+      tb_real Nmn_second = l_m*Nmn_dst_pos;                    /* Start second line Rx (correct) */
+      tb_real Nmn_lost = Nmn_pos - Nmn_first - Nmn_second;     /* Positive cases lost to follow up - go to Nmn */
+      tb_real Nmn_first_success = Nmn_first*tneg_s*eff_n;      /* First line success - go to Lmp */
+      tb_real Nmn_first_fail = Nmn_first - Nmn_first_success;  /* First line failure - go to Nmp */
+      tb_real Nmn_second_success = Nmn_second*tneg_m;          /* Second line success - go to Lmp */
+      tb_real Nmn_second_fail = Nmn_second*(1-tneg_m);         /* Second line failure - go to Nmp */
 
       /* sm-, MDR, previous Rx history */
-      double Nmp_pos = kneg*se_N_neg*rel_d*Nmp[i];            /* TB positive - move all out of Nmp */
-      double Nmp_dst = Nmp_pos*dstneg_p;                      /* Get DST */
-      double Nmp_dst_pos = Nmp_dst*se_m_neg;                  /* True pos on DST */
-      double Nmp_first = l_s*(Nmp_pos - Nmp_dst_pos);         /* Start first line Rx (incorrect) */  
-      double Nmp_second = l_m*Nmp_dst_pos;                    /* Start second line Rx (correct) */
-      double Nmp_lost = Nmp_pos - Nmp_first - Nmp_second;     /* Positive cases lost to follow up - go to Nmp */
-      double Nmp_first_success = Nmp_first*tneg_s*eff_p;      /* First line success - go to Lmp */
-      double Nmp_first_fail = Nmp_first - Nmp_first_success;  /* First line failure - go to Nmp */
-      double Nmp_second_success = Nmp_second*tneg_m;          /* Second line success - go to Lmp */
-      double Nmp_second_fail = Nmp_second*(1-tneg_m);         /* Second line failure - go to Nmp */
+      tb_real Nmp_pos = kneg*se_N_neg*rel_d*Nmp[i];            /* TB positive - move all out of Nmp */
+      tb_real Nmp_dst = Nmp_pos*dstneg_p;                      /* Get DST */
+      tb_real Nmp_dst_pos = Nmp_dst*se_m_neg;                  /* True pos on DST */
+      tb_real Nmp_first = l_s*(Nmp_pos - Nmp_dst_pos);         /* Start first line Rx (incorrect) */  
+      tb_real Nmp_second = l_m*Nmp_dst_pos;                    /* Start second line Rx (correct) */
+      tb_real Nmp_lost = Nmp_pos - Nmp_first - Nmp_second;     /* Positive cases lost to follow up - go to Nmp */
+      tb_real Nmp_first_success = Nmp_first*tneg_s*eff_p;      /* First line success - go to Lmp */
+      tb_real Nmp_first_fail = Nmp_first - Nmp_first_success;  /* First line failure - go to Nmp */
+      tb_real Nmp_second_success = Nmp_second*tneg_m;          /* Second line success - go to Lmp */
+      tb_real Nmp_second_fail = Nmp_second*(1-tneg_m);         /* Second line failure - go to Nmp */
 
       /* sm+, MDR, no Rx history */
-      double Imn_pos = kneg*se_I_neg*Imn[i];                  /* TB positive - move all out of Imn */
-      double Imn_dst = Imn_pos*dstneg_n;                      /* Get DST */
-      double Imn_dst_pos = Imn_dst*se_m_neg;                  /* True pos on DST */
-      double Imn_first = l_s*(Imn_pos - Imn_dst_pos);         /* Start first line Rx (incorrect) */  
-      double Imn_second = l_m*Imn_dst_pos;                    /* Start second line Rx (correct) */
-      double Imn_lost = Imn_pos - Imn_first - Imn_second;     /* Positive cases lost to follow up - go to Imn */
-      double Imn_first_success = Imn_first*tneg_s*eff_n;      /* First line success - go to Lmp */
-      double Imn_first_fail = Imn_first - Imn_first_success;  /* First line failure - go to Imp */
-      double Imn_second_success = Imn_second*tneg_m;          /* Second line success - go to Lmp */
-      double Imn_second_fail = Imn_second*(1-tneg_m);         /* Second line failure - go to Imp */
+      tb_real Imn_pos = kneg*se_I_neg*Imn[i];                  /* TB positive - move all out of Imn */
+      tb_real Imn_dst = Imn_pos*dstneg_n;                      /* Get DST */
+      tb_real Imn_dst_pos = Imn_dst*se_m_neg;                  /* True pos on DST */
+      tb_real Imn_first = l_s*(Imn_pos - Imn_dst_pos);         /* Start first line Rx (incorrect) */  
+      tb_real Imn_second = l_m*Imn_dst_pos;                    /* Start second line Rx (correct) */
+      tb_real Imn_lost = Imn_pos - Imn_first - Imn_second;     /* Positive cases lost to follow up - go to Imn */
+      tb_real Imn_first_success = Imn_first*tneg_s*eff_n;      /* First line success - go to Lmp */
+      tb_real Imn_first_fail = Imn_first - Imn_first_success;  /* First line failure - go to Imp */
+      tb_real Imn_second_success = Imn_second*tneg_m;          /* Second line success - go to Lmp */
+      tb_real Imn_second_fail = Imn_second*(1-tneg_m);         /* Second line failure - go to Imp */
 
       /* sm+, MDR, previous Rx history */
-      double Imp_pos = kneg*se_I_neg*Imp[i];                  /* TB positive - move all out of Imp */
-      double Imp_dst = Imp_pos*dstneg_p;                      /* Get DST */
-      double Imp_dst_pos = Imp_dst*se_m_neg;                  /* True pos on DST */
-      double Imp_first = l_s*(Imp_pos - Imp_dst_pos);         /* Start first line Rx (incorrect) */  
-      double Imp_second = l_m*Imp_dst_pos;                    /* Start second line Rx (correct) */
-      double Imp_lost = Imp_pos - Imp_first - Imp_second;     /* Positive cases lost to follow up - go to Imp */
-      double Imp_first_success = Imp_first*tneg_s*eff_p;      /* First line success - go to Lmp */
-      double Imp_first_fail = Imp_first - Imp_first_success;  /* First line failure - go to Imp */
-      double Imp_second_success = Imp_second*tneg_m;          /* Second line success - go to Lmp */
-      double Imp_second_fail = Imp_second*(1-tneg_m);         /* Second line failure - go to Imp */
+      tb_real Imp_pos = kneg*se_I_neg*Imp[i];                  /* TB positive - move all out of Imp */
+      tb_real Imp_dst = Imp_pos*dstneg_p;                      /* Get DST */
+      tb_real Imp_dst_pos = Imp_dst*se_m_neg;                  /* True pos on DST */
+      tb_real Imp_first = l_s*(Imp_pos - Imp_dst_pos);         /* Start first line Rx (incorrect) */  
+      tb_real Imp_second = l_m*Imp_dst_pos;                    /* Start second line Rx (correct) */
+      tb_real Imp_lost = Imp_pos - Imp_first - Imp_second;     /* Positive cases lost to follow up - go to Imp */
+      tb_real Imp_first_success = Imp_first*tneg_s*eff_p;      /* First line success - go to Lmp */
+      tb_real Imp_first_fail = Imp_first - Imp_first_success;  /* First line failure - go to Imp */
+      tb_real Imp_second_success = Imp_second*tneg_m;          /* Second line success - go to Lmp */
+      tb_real Imp_second_fail = Imp_second*(1-tneg_m);         /* Second line failure - go to Imp */
 
 
       /* Susceptible - NOTE BIRTHS ARE ADDED TO HERE IN THE EVENTS FUNCTION*/
       dS[i] = - (FS + FM)*S[i] - /* Infection */ 
-              forc[iz+82]*S[i] - m_b[i]*S[i] + (S[i]/tot_age[i])*(forc[iz+116]/5); /* HIV, death, migration */
+              HIV_inc*S[i] - m_b[i]*S[i] + (S[i]/tot_age[i])*(forc[iz+116]/5); /* HIV, death, migration */
        
       /* Latent, ds, naive */
       dLsn[i] = - m_b[i]*Lsn[i] + /* Death */
                 S_to_Lsn + Lmn_to_Lsn + PTn_to_Lsn- Lsn_to_Lmn - Lsn_to_Nsn - Lsn_to_Isn  - Lsn_to_Nmn - Lsn_to_Imn - /* Infection and disease */
-                forc[iz+82]*Lsn[i] + (Lsn[i]/tot_age[i])*(forc[iz+116]/5) + r*(Isn[i] + Nsn[i])  - /* HIV, migration, self-cure */
+                HIV_inc*Lsn[i] + (Lsn[i]/tot_age[i])*(forc[iz+116]/5) + r*(Isn[i] + Nsn[i])  - /* HIV, migration, self-cure */
                 false_pos*tneg_s*Lsn[i]; /* False positive Rx */                   
       
       /* Latent, ds, prev */
       dLsp[i] = - m_b[i]*Lsp[i] +  /* Death */ 
                 Lmp_to_Lsp + PTp_to_Lsp - Lsp_to_Lmp - Lsp_to_Nsp - Lsp_to_Isp  - Lsp_to_Nmp - Lsp_to_Imp + /* Infection and disease */   
                 Nsn_first_success + Nsn_second_success + Nsp_first_success + Nsp_second_success + Isn_first_success + Isn_second_success + Isp_first_success + Isp_second_success - /* Rx */
-                forc[iz+82]*Lsp[i] + (Lsp[i]/tot_age[i])*(forc[iz+116]/5) + r*(Isp[i] + Nsp[i]) - /* HIV, migration, self-cure */
+                HIV_inc*Lsp[i] + (Lsp[i]/tot_age[i])*(forc[iz+116]/5) + r*(Isp[i] + Nsp[i]) - /* HIV, migration, self-cure */
                 false_pos*tneg_s*Lsp[i]; /* False positive Rx */         
 
       /* Latent, mdr, naive */ 
       dLmn[i] = - m_b[i]*Lmn[i] + /* Death */
                 S_to_Lmn + Lsn_to_Lmn + PTn_to_Lmn - Lmn_to_Lsn - Lmn_to_Nsn - Lmn_to_Isn - Lmn_to_Nmn - Lmn_to_Imn - /* Infection and disease */              
-                forc[iz+82]*Lmn[i] + (Lmn[i]/tot_age[i])*(forc[iz+116]/5) + r*(Imn[i] + Nmn[i]); /* HIV, migration, self-cure */            
+                HIV_inc*Lmn[i] + (Lmn[i]/tot_age[i])*(forc[iz+116]/5) + r*(Imn[i] + Nmn[i]); /* HIV, migration, self-cure */            
       
       /* Latent, mdr, prev */
       dLmp[i] = - m_b[i]*Lmp[i] + /* Death */
                 Lsp_to_Lmp + PTp_to_Lmp - Lmp_to_Lsp - Lmp_to_Nsp - Lmp_to_Isp - Lmp_to_Nmp - Lmp_to_Imp + /* Infection and disease */
                 Nmn_first_success + Nmn_second_success + Nmp_first_success + Nmp_second_success + Imn_first_success + Imn_second_success + Imp_first_success + Imp_second_success - /* Rx */
-                forc[iz+82]*Lmp[i] + (Lmp[i]/tot_age[i])*(forc[iz+116]/5)  + r*(Imp[i] + Nmp[i]); /* HIV, migration, self-cure */  
+                HIV_inc*Lmp[i] + (Lmp[i]/tot_age[i])*(forc[iz+116]/5)  + r*(Imp[i] + Nmp[i]); /* HIV, migration, self-cure */  
                 
       /* Smear neg, ds, new */
       dNsn[i] = - m_b[i]*Nsn[i] + /* Death */ 
                 S_to_Nsn + Lsn_to_Nsn + Lmn_to_Nsn + PTn_to_Nsn - /* Disease */
                 Nsn_pos + Nsn_lost - /* Diagnosis, pre Rx lost */ 
-                forc[iz+82]*Nsn[i] + (Nsn[i]/tot_age[i])*(forc[iz+116]/5)  - (theta + r + muN_age[i])*Nsn[i]; /* HIV, migration, sm conversion, self-cure, TB death */ 
+                HIV_inc*Nsn[i] + (Nsn[i]/tot_age[i])*(forc[iz+116]/5)  - (theta + r + muN_age[i])*Nsn[i]; /* HIV, migration, sm conversion, self-cure, TB death */ 
       
       /* Smear neg, ds, prev */                             
       dNsp[i] = - m_b[i]*Nsp[i] + /* Death */
                 Lsp_to_Nsp + Lmp_to_Nsp + PTp_to_Nsp - /* Disease */
                 Nsp_pos + Nsp_lost + Nsn_first_fail + Nsn_second_fail + Nsp_first_fail + Nsp_second_fail - /* Diagnosis, pre Rx lost, failed Rx */
-                forc[iz+82]*Nsp[i] + (Nsp[i]/tot_age[i])*(forc[iz+116]/5) - (theta + r + muN_age[i])*Nsp[i]; /* HIV, migration, sm conversion, self-cure, TB death */  
+                HIV_inc*Nsp[i] + (Nsp[i]/tot_age[i])*(forc[iz+116]/5) - (theta + r + muN_age[i])*Nsp[i]; /* HIV, migration, sm conversion, self-cure, TB death */  
 
       /* Smear neg, mdr, new */
       dNmn[i] = - m_b[i]*Nmn[i] + /* Death */ 
                 S_to_Nmn + Lsn_to_Nmn + Lmn_to_Nmn + PTn_to_Nmn - /* Disease */
                 Nmn_pos + Nmn_lost - /* Diagnosis, pre Rx lost */
-                forc[iz+82]*Nmn[i] + (Nmn[i]/tot_age[i])*(forc[iz+116]/5)  - (theta + r + muN_age[i])*Nmn[i]; /* HIV, migration, sm conversion, self-cure, TB death */    
+                HIV_inc*Nmn[i] + (Nmn[i]/tot_age[i])*(forc[iz+116]/5)  - (theta + r + muN_age[i])*Nmn[i]; /* HIV, migration, sm conversion, self-cure, TB death */    
                    
       /* Smear neg, mdr, prev */
       dNmp[i] = - m_b[i]*Nmp[i] + /* Death */
                 Lsp_to_Nmp + Lmp_to_Nmp + PTp_to_Nmp  - /* Disease */
                 Nmp_pos + Nmp_lost + Nmn_first_fail + Nmn_second_fail + Nmp_first_fail + Nmp_second_fail + Nsn_res + Nsp_res - /* Diagnosis, pre Rx lost, failed Rx, acquired resistance */
-                forc[iz+82]*Nmp[i] + (Nmp[i]/tot_age[i])*(forc[iz+116]/5) - (theta + r + muN_age[i])*Nmp[i];  /* HIV, migration, sm conversion, self-cure, TB death */
+                HIV_inc*Nmp[i] + (Nmp[i]/tot_age[i])*(forc[iz+116]/5) - (theta + r + muN_age[i])*Nmp[i];  /* HIV, migration, sm conversion, self-cure, TB death */
 
       /* Smear pos, ds, new */
       dIsn[i] = - m_b[i]*Isn[i] + /* Death */
                 S_to_Isn + Lsn_to_Isn + Lmn_to_Isn + PTn_to_Isn - /* Disease */
                 Isn_pos + Isn_lost - /* Diagnosis, pre Rx lost */  
-                forc[iz+82]*Isn[i] + (Isn[i]/tot_age[i])*(forc[iz+116]/5) + theta*Nsn[i] - (r + muI_age[i])*Isn[i]; /* HIV, migration, sm conversion, self-cure, TB death */  
+                HIV_inc*Isn[i] + (Isn[i]/tot_age[i])*(forc[iz+116]/5) + theta*Nsn[i] - (r + muI_age[i])*Isn[i]; /* HIV, migration, sm conversion, self-cure, TB death */  
       
       /* Smear pos, ds, prev */
       dIsp[i] = - m_b[i]*Isp[i] + /* Death */
                 Lsp_to_Isp + Lmp_to_Isp + PTp_to_Isp - /* Disease */   
                 Isp_pos + Isp_lost + Isn_first_fail + Isn_second_fail + Isp_first_fail + Isp_second_fail - /* Diagnosis, pre Rx lost, failed Rx */
-                forc[iz+82]*Isp[i] + (Isp[i]/tot_age[i])*(forc[iz+116]/5) + theta*Nsp[i] - (r + muI_age[i])*Isp[i]; /* HIV, migration, sm conversion, self-cure, TB death */
+                HIV_inc*Isp[i] + (Isp[i]/tot_age[i])*(forc[iz+116]/5) + theta*Nsp[i] - (r + muI_age[i])*Isp[i]; /* HIV, migration, sm conversion, self-cure, TB death */
 
       /* Smear pos, mdr, new */
       dImn[i] = - m_b[i]*Imn[i] + /* Death */
                 S_to_Imn + Lsn_to_Imn + Lmn_to_Imn + PTn_to_Imn - /* Disease */
                 Imn_pos + Imn_lost - /* Diagnosis, pre Rx lost, failed Rx */ 
-                forc[iz+82]*Imn[i] + (Imn[i]/tot_age[i])*(forc[iz+116]/5)  + theta*Nmn[i] - (r + muI_age[i])*Imn[i]; /* HIV, migration, sm conversion, self-cure, TB death */  
+                HIV_inc*Imn[i] + (Imn[i]/tot_age[i])*(forc[iz+116]/5)  + theta*Nmn[i] - (r + muI_age[i])*Imn[i]; /* HIV, migration, sm conversion, self-cure, TB death */  
                 
       /* Smear pos, mdr, prev */
       dImp[i] = - m_b[i]*Imp[i] /* Death */
                 + Lsp_to_Imp + Lmp_to_Imp + PTp_to_Imp - /* Disease */
                 Imp_pos + Imp_lost + Imn_first_fail + Imn_second_fail + Imp_first_fail + Imp_second_fail + Isn_res + Isp_res - /* Diagnosis, pre Rx lost, failed Rx, acquired resistance */
-                forc[iz+82]*Imp[i] + (Imp[i]/tot_age[i])*(forc[iz+116]/5) + theta*Nmp[i] - (r + muI_age[i])*Imp[i]; /* HIV, migration, sm conversion, self-cure, TB death */ 
+                HIV_inc*Imp[i] + (Imp[i]/tot_age[i])*(forc[iz+116]/5) + theta*Nmp[i] - (r + muI_age[i])*Imp[i]; /* HIV, migration, sm conversion, self-cure, TB death */ 
                 
       /* Post PT, ds, new */          
       dPTn[i] = - m_b[i]*PTn[i] - /* Death */
                 PTn_to_Lsn - PTn_to_Nsn - PTn_to_Isn - PTn_to_Lmn - PTn_to_Nmn - PTn_to_Imn + /* Infection and disease */
                 false_pos*tneg_s*Lsn[i] - /* Incorrect Rx for latent infected */
-                forc[iz+82]*PTn[i] + (PTn[i]/tot_age[i])*(forc[iz+116]/5); /* HIV, migration */
+                HIV_inc*PTn[i] + (PTn[i]/tot_age[i])*(forc[iz+116]/5); /* HIV, migration */
       
       /* Post PT, ds, prev */ 
       dPTp[i] = - m_b[i]*PTp[i] - /* Death */
                 PTp_to_Lsp - PTp_to_Nsp - PTp_to_Isp - PTp_to_Lmp - PTp_to_Nmp - PTp_to_Imp + /* Infection and disease */
                 false_pos*tneg_s*Lsp[i] - /* Incorrect Rx for latent infected */
-                forc[iz+82]*PTp[i] + (PTp[i]/tot_age[i])*(forc[iz+116]/5); /* HIV, migration */
+                HIV_inc*PTp[i] + (PTp[i]/tot_age[i])*(forc[iz+116]/5); /* HIV, migration */
                         
       /* sum up new HIV- cases */           
       TB_cases_neg_age[i] = (v_age[i]*(1-sig_age[i]) + FS*a_age[i]*(1-p)*(1-sig_age[i]))*Lsn[i] + FS*a_age[i]*(1-sig_age[i])*(S[i] + (1-p)*(Lmn[i] + PTn[i])) + /*sneg,sus,new*/
@@ -1092,261 +1425,259 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
                             (v_age[i]*sig_age[i] + FM*a_age[i]*sig_age[i]*(1-p))*Lmn[i] + FM*a_age[i]*sig_age[i]*(S[i] + (1-p)*(Lsn[i] + PTn[i]))  +            /*spos,mdr,new*/
                             (v_age[i]*sig_age[i] + FM*a_age[i]*sig_age[i]*(1-p))*Lmp[i] + FM*a_age[i]*sig_age[i]*(1-p)*(Lsp[i] + PTp[i]);                       /*spos,mdr,prev*/
                             
-      TB_cases_neg = TB_cases_neg + TB_cases_neg_age[i];
-    
       TB_cases_age[i] = TB_cases_age[i] + TB_cases_neg_age[i];
     
         /* HIV+: Loop through CD4 categories */
     
-        if (HIV_run>0.0){   /* don't run these for equilibrium as no HIV - save time */
+        if (tb_re(HIV_run)>0.0){   /* don't run these for equilibrium as no HIV - save time */
     
         for (j=0; j<n_HIV; j++){      /* CD4 */
 
       /* Calculate the disease flows here and use these in the derivatives - intention is to make the model more flexible/easier to understand */
       
-          double SH_to_LsnH = FS*(1-a_age_H[i][j])*S_H[i][j];                                /* Susceptible to latent DS infection (no disease history) */
-          double SH_to_NsnH = FS*a_age_H[i][j]*(1-sig_H)*S_H[i][j];                          /* Susceptible to primary DS smear negative disease (no disease history) */
-          double SH_to_IsnH = FS*a_age_H[i][j]*sig_H*S_H[i][j];                              /* Susceptible to primary DS smear positive disease (no disease history) */
-          double SH_to_LmnH = FM*(1-a_age_H[i][j])*S_H[i][j];                                /* Susceptible to latent DR infection (no disease history) */
-          double SH_to_NmnH = FM*a_age_H[i][j]*(1-sig_H)*S_H[i][j];                          /* Susceptible to primary DR smear negative disease (no disease history) */
-          double SH_to_ImnH = FM*a_age_H[i][j]*sig_H*S_H[i][j];                              /* Susceptible to primary DR smear positive disease (no disease history) */
+          tb_real SH_to_LsnH = FS*(1-a_age_H[i][j])*S_H[i][j];                                /* Susceptible to latent DS infection (no disease history) */
+          tb_real SH_to_NsnH = FS*a_age_H[i][j]*(1-sig_H)*S_H[i][j];                          /* Susceptible to primary DS smear negative disease (no disease history) */
+          tb_real SH_to_IsnH = FS*a_age_H[i][j]*sig_H*S_H[i][j];                              /* Susceptible to primary DS smear positive disease (no disease history) */
+          tb_real SH_to_LmnH = FM*(1-a_age_H[i][j])*S_H[i][j];                                /* Susceptible to latent DR infection (no disease history) */
+          tb_real SH_to_NmnH = FM*a_age_H[i][j]*(1-sig_H)*S_H[i][j];                          /* Susceptible to primary DR smear negative disease (no disease history) */
+          tb_real SH_to_ImnH = FM*a_age_H[i][j]*sig_H*S_H[i][j];                              /* Susceptible to primary DR smear positive disease (no disease history) */
       
-          double LsnH_to_NsnH = (v_age_H[i][j] + FS*a_age_H[i][j]*(1-p_H[j]))*(1-sig_H)*Lsn_H[i][j];   /* Latent DS to smear negative DS disease (no disease history) - reactivation and reinfection */ 
-          double LsnH_to_IsnH = (v_age_H[i][j] + FS*a_age_H[i][j]*(1-p_H[j]))*sig_H*Lsn_H[i][j];       /* Latent DS to smear positive DS disease (no disease history) - reactivation and reinfection */ 
-          double LsnH_to_NmnH = FM*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*Lsn_H[i][j];                     /* Latent DS to smear negative DR disease (no disease history) - co-infection */ 
-          double LsnH_to_ImnH = FM*a_age_H[i][j]*(1-p_H[j])*sig_H*Lsn_H[i][j];                         /* Latent DS to smear positive DR disease (no disease history) - co-infection */
-          double LsnH_to_LmnH = FM*(1-a_age_H[i][j])*(1-p_H[j])*g*Lsn_H[i][j];                         /* Latent DS to latent DR (no disease history) */
+          tb_real LsnH_to_NsnH = (v_age_H[i][j] + FS*a_age_H[i][j]*(1-p_H[j]))*(1-sig_H)*Lsn_H[i][j];   /* Latent DS to smear negative DS disease (no disease history) - reactivation and reinfection */ 
+          tb_real LsnH_to_IsnH = (v_age_H[i][j] + FS*a_age_H[i][j]*(1-p_H[j]))*sig_H*Lsn_H[i][j];       /* Latent DS to smear positive DS disease (no disease history) - reactivation and reinfection */ 
+          tb_real LsnH_to_NmnH = FM*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*Lsn_H[i][j];                     /* Latent DS to smear negative DR disease (no disease history) - co-infection */ 
+          tb_real LsnH_to_ImnH = FM*a_age_H[i][j]*(1-p_H[j])*sig_H*Lsn_H[i][j];                         /* Latent DS to smear positive DR disease (no disease history) - co-infection */
+          tb_real LsnH_to_LmnH = FM*(1-a_age_H[i][j])*(1-p_H[j])*g*Lsn_H[i][j];                         /* Latent DS to latent DR (no disease history) */
       
-          double LmnH_to_NmnH = (v_age_H[i][j] + FM*a_age_H[i][j]*(1-p_H[j]))*(1-sig_H)*Lmn_H[i][j];   /* Latent DR to smear negative DR disease (no disease history) - reactivation and reinfection */ 
-          double LmnH_to_ImnH = (v_age_H[i][j] + FM*a_age_H[i][j]*(1-p_H[j]))*sig_H*Lmn_H[i][j];       /* Latent DR to smear positive DR disease (no disease history) - reactivation and reinfection */ 
-          double LmnH_to_NsnH = FS*a_age_H[i][j]*(1-sig_H)*(1-p_H[j])*Lmn_H[i][j];                     /* Latent DR to smear negative DS disease (no disease history) - co-infection */
-          double LmnH_to_IsnH = FS*a_age_H[i][j]*sig_H*(1-p_H[j])*Lmn_H[i][j];                         /* Latent DR to smear positive DS disease (no disease history) - co-infection */
-          double LmnH_to_LsnH = FS*(1-a_age_H[i][j])*(1-p_H[j])*(1-g)*Lmn_H[i][j];                     /* Latent DR to latent DS (no disease history) */
-
-          double LspH_to_NspH = (v_age_H[i][j] + FS*a_age_H[i][j]*(1-p_H[j]))*(1-sig_H)*Lsp_H[i][j];   /* Latent DS to smear negative DS disease (prior Rx) - reactivation and reinfection */ 
-          double LspH_to_IspH = (v_age_H[i][j] + FS*a_age_H[i][j]*(1-p_H[j]))*sig_H*Lsp_H[i][j];       /* Latent DS to smear positive DS disease (prior Rx) - reactivation and reinfection */     
-          double LspH_to_NmpH = FM*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*Lsp_H[i][j];                     /* Latent DS to smear negative DR disease (prior_rx) - reactivation and reinfection */ 
-          double LspH_to_ImpH = FM*a_age_H[i][j]*(1-p_H[j])*sig_H*Lsp_H[i][j];                         /* Latent DS to smear positive DR disease (prior_Rx) - reactivation and reinfection */
-          double LspH_to_LmpH = FM*(1-a_age_H[i][j])*(1-p_H[j])*g*Lsp_H[i][j];                         /* Latent DS to latent DR (prior Rx) */
+          tb_real LmnH_to_NmnH = (v_age_H[i][j] + FM*a_age_H[i][j]*(1-p_H[j]))*(1-sig_H)*Lmn_H[i][j];   /* Latent DR to smear negative DR disease (no disease history) - reactivation and reinfection */ 
+          tb_real LmnH_to_ImnH = (v_age_H[i][j] + FM*a_age_H[i][j]*(1-p_H[j]))*sig_H*Lmn_H[i][j];       /* Latent DR to smear positive DR disease (no disease history) - reactivation and reinfection */ 
+          tb_real LmnH_to_NsnH = FS*a_age_H[i][j]*(1-sig_H)*(1-p_H[j])*Lmn_H[i][j];                     /* Latent DR to smear negative DS disease (no disease history) - co-infection */
+          tb_real LmnH_to_IsnH = FS*a_age_H[i][j]*sig_H*(1-p_H[j])*Lmn_H[i][j];                         /* Latent DR to smear positive DS disease (no disease history) - co-infection */
+          tb_real LmnH_to_LsnH = FS*(1-a_age_H[i][j])*(1-p_H[j])*(1-g)*Lmn_H[i][j];                     /* Latent DR to latent DS (no disease history) */
+
+          tb_real LspH_to_NspH = (v_age_H[i][j] + FS*a_age_H[i][j]*(1-p_H[j]))*(1-sig_H)*Lsp_H[i][j];   /* Latent DS to smear negative DS disease (prior Rx) - reactivation and reinfection */ 
+          tb_real LspH_to_IspH = (v_age_H[i][j] + FS*a_age_H[i][j]*(1-p_H[j]))*sig_H*Lsp_H[i][j];       /* Latent DS to smear positive DS disease (prior Rx) - reactivation and reinfection */     
+          tb_real LspH_to_NmpH = FM*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*Lsp_H[i][j];                     /* Latent DS to smear negative DR disease (prior_rx) - reactivation and reinfection */ 
+          tb_real LspH_to_ImpH = FM*a_age_H[i][j]*(1-p_H[j])*sig_H*Lsp_H[i][j];                         /* Latent DS to smear positive DR disease (prior_Rx) - reactivation and reinfection */
+          tb_real LspH_to_LmpH = FM*(1-a_age_H[i][j])*(1-p_H[j])*g*Lsp_H[i][j];                         /* Latent DS to latent DR (prior Rx) */
       
-          double LmpH_to_NmpH = (v_age_H[i][j] + FM*a_age_H[i][j]*(1-p_H[j]))*(1-sig_H)*Lmp_H[i][j];   /* Latent DR to smear negative DR disease (prior Rx) - reactivation and reinfection */ 
-          double LmpH_to_ImpH = (v_age_H[i][j] + FM*a_age_H[i][j]*(1-p_H[j]))*sig_H*Lmp_H[i][j];       /* Latent DR to smear positive DR disease (prior Rx) - reactivation and reinfection */     
-          double LmpH_to_NspH = FS*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*Lmp_H[i][j];                     /* Latent DR to smear negative DS disease (prior_rx) - reactivation and reinfection */ 
-          double LmpH_to_IspH = FS*a_age_H[i][j]*(1-p_H[j])*sig_H*Lmp_H[i][j];                         /* Latent DR to smear positive DS disease (prior_Rx) - reactivation and reinfection */
-          double LmpH_to_LspH = FS*(1-a_age_H[i][j])*(1-p_H[j])*(1-g)*Lmp_H[i][j];                     /* Latent DR to latent DS (prior Rx) */
-
-          double PTnH_to_LsnH = FS*(1-a_age_H[i][j])*(1-p_H[j])*PTn_H[i][j];            /* Post PT to latent DS (no disease history) */
-          double PTnH_to_NsnH = FS*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*PTn_H[i][j];      /* Post PT to smear negative DS disease (no disease history) */
-          double PTnH_to_IsnH = FS*a_age_H[i][j]*(1-p_H[j])*sig_H*PTn_H[i][j];          /* Post PT to smear positive DS disease (no disease history) */
-          double PTnH_to_LmnH = FM*(1-a_age_H[i][j])*(1-p_H[j])*g*PTn_H[i][j];          /* Post PT to latent DR (no disease history) */
-          double PTnH_to_NmnH = FM*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*PTn_H[i][j];      /* Post PT to smear negative DR disease (no disease history) */
-          double PTnH_to_ImnH = FM*a_age_H[i][j]*(1-p_H[j])*sig_H*PTn_H[i][j];          /* Post PT to smear positive DR disease (no disease history) */
+          tb_real LmpH_to_NmpH = (v_age_H[i][j] + FM*a_age_H[i][j]*(1-p_H[j]))*(1-sig_H)*Lmp_H[i][j];   /* Latent DR to smear negative DR disease (prior Rx) - reactivation and reinfection */ 
+          tb_real LmpH_to_ImpH = (v_age_H[i][j] + FM*a_age_H[i][j]*(1-p_H[j]))*sig_H*Lmp_H[i][j];       /* Latent DR to smear positive DR disease (prior Rx) - reactivation and reinfection */     
+          tb_real LmpH_to_NspH = FS*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*Lmp_H[i][j];                     /* Latent DR to smear negative DS disease (prior_rx) - reactivation and reinfection */ 
+          tb_real LmpH_to_IspH = FS*a_age_H[i][j]*(1-p_H[j])*sig_H*Lmp_H[i][j];                         /* Latent DR to smear positive DS disease (prior_Rx) - reactivation and reinfection */
+          tb_real LmpH_to_LspH = FS*(1-a_age_H[i][j])*(1-p_H[j])*(1-g)*Lmp_H[i][j];                     /* Latent DR to latent DS (prior Rx) */
+
+          tb_real PTnH_to_LsnH = FS*(1-a_age_H[i][j])*(1-p_H[j])*PTn_H[i][j];            /* Post PT to latent DS (no disease history) */
+          tb_real PTnH_to_NsnH = FS*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*PTn_H[i][j];      /* Post PT to smear negative DS disease (no disease history) */
+          tb_real PTnH_to_IsnH = FS*a_age_H[i][j]*(1-p_H[j])*sig_H*PTn_H[i][j];          /* Post PT to smear positive DS disease (no disease history) */
+          tb_real PTnH_to_LmnH = FM*(1-a_age_H[i][j])*(1-p_H[j])*g*PTn_H[i][j];          /* Post PT to latent DR (no disease history) */
+          tb_real PTnH_to_NmnH = FM*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*PTn_H[i][j];      /* Post PT to smear negative DR disease (no disease history) */
+          tb_real PTnH_to_ImnH = FM*a_age_H[i][j]*(1-p_H[j])*sig_H*PTn_H[i][j];          /* Post PT to smear positive DR disease (no disease history) */
       
-          double PTpH_to_LspH = FS*(1-a_age_H[i][j])*(1-p_H[j])*PTp_H[i][j];            /* Post PT to latent DS (prior Rx) */
-          double PTpH_to_NspH = FS*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*PTp_H[i][j];      /* Post PT to smear negative DS disease (prior Rx) */
-          double PTpH_to_IspH = FS*a_age_H[i][j]*(1-p_H[j])*sig_H*PTp_H[i][j];          /* Post PT to smear positive DS disease (prior Rx) */
-          double PTpH_to_LmpH = FM*(1-a_age_H[i][j])*(1-p_H[j])*g*PTp_H[i][j];          /* Post PT to latent DR (prior Rx) */
-          double PTpH_to_NmpH = FM*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*PTp_H[i][j];      /* Post PT to smear negative DR disease (prior Rx) */
-          double PTpH_to_ImpH = FM*a_age_H[i][j]*(1-p_H[j])*sig_H*PTp_H[i][j];          /* Post PT to smear positive DR disease (prior Rx) */
+          tb_real PTpH_to_LspH = FS*(1-a_age_H[i][j])*(1-p_H[j])*PTp_H[i][j];            /* Post PT to latent DS (prior Rx) */
+          tb_real PTpH_to_NspH = FS*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*PTp_H[i][j];      /* Post PT to smear negative DS disease (prior Rx) */
+          tb_real PTpH_to_IspH = FS*a_age_H[i][j]*(1-p_H[j])*sig_H*PTp_H[i][j];          /* Post PT to smear positive DS disease (prior Rx) */
+          tb_real PTpH_to_LmpH = FM*(1-a_age_H[i][j])*(1-p_H[j])*g*PTp_H[i][j];          /* Post PT to latent DR (prior Rx) */
+          tb_real PTpH_to_NmpH = FM*a_age_H[i][j]*(1-p_H[j])*(1-sig_H)*PTp_H[i][j];      /* Post PT to smear negative DR disease (prior Rx) */
+          tb_real PTpH_to_ImpH = FM*a_age_H[i][j]*(1-p_H[j])*sig_H*PTp_H[i][j];          /* Post PT to smear positive DR disease (prior Rx) */
 
           /* Calculate "care" flows here and use these in the derivatives */
           
           /* TB notification may trigger HIV test and ART initiation */
           /* Some proportion (HIV_test*HIV_link) of those notified (i.e. started on Rx) move to corresponding ART compartment */
-          double HIV_ART = HIV_test*ART_link;
+          tb_real HIV_ART = HIV_test*ART_link;
 
-          double false_pos = health*kpos*(1-sp_I_pos*sp_N_pos)*l_s;   /* Susceptible, latently infected and post-PT are false pos notif at this rate (includes link to Rx). */
+          tb_real false_pos = health*kpos*(1-sp_I_pos*sp_N_pos)*l_s;   /* Susceptible, latently infected and post-PT are false pos notif at this rate (includes link to Rx). */
                                                                       /* This only has any effect in those latently infected with drug sus strains. tpos_s complete Rx and move to PTn/PTp */
           /* sm-, drug sus, no Rx history */    
-          double NsnH_pos = kpos*se_N_pos*rel_d*Nsn_H[i][j];        /* TB positive - move all out of Nsn_H */
-          double NsnH_dst = NsnH_pos*dstpos_n;                      /* Get DST */
-          double NsnH_dst_fpos = NsnH_dst*(1-sp_m_pos);             /* False pos on DST */
-          double NsnH_first = l_s*(NsnH_pos - NsnH_dst_fpos);       /* Start first line Rx (correct) */     
-          double NsnH_second = l_m*(NsnH_dst_fpos);                 /* Start second line treatment (incorrect) */
-          double NsnH_lost = NsnH_pos - NsnH_first - NsnH_second;   /* Positive cases lost to follow up  - go to Nsn_H */ 
-          double NsnH_res = NsnH_first*e;                           /* Develop resistance - split between Nmp_H and Nmp_A */
-          double NsnH_first_success = (NsnH_first-NsnH_res)*tpos_s; /* First line success - split between Lsp_H and Lsp_A */
-          double NsnH_first_fail = (NsnH_first-NsnH_res)*(1-tpos_s);/* First line failure - split between Nsp_H and Nsp_A */
-          double NsnH_second_success = NsnH_second*tpos_m;          /* Second line success - split between Lsp_H and Lsp_A */
-          double NsnH_second_fail = NsnH_second*(1-tpos_m);         /* Second line failure - split between Nsp_H and Nsp_A */
+          tb_real NsnH_pos = kpos*se_N_pos*rel_d*Nsn_H[i][j];        /* TB positive - move all out of Nsn_H */
+          tb_real NsnH_dst = NsnH_pos*dstpos_n;                      /* Get DST */
+          tb_real NsnH_dst_fpos = NsnH_dst*(1-sp_m_pos);             /* False pos on DST */
+          tb_real NsnH_first = l_s*(NsnH_pos - NsnH_dst_fpos);       /* Start first line Rx (correct) */     
+          tb_real NsnH_second = l_m*(NsnH_dst_fpos);                 /* Start second line treatment (incorrect) */
+          tb_real NsnH_lost = NsnH_pos - NsnH_first - NsnH_second;   /* Positive cases lost to follow up  - go to Nsn_H */ 
+          tb_real NsnH_res = NsnH_first*e;                           /* Develop resistance - split between Nmp_H and Nmp_A */
+          tb_real NsnH_first_success = (NsnH_first-NsnH_res)*tpos_s; /* First line success - split between Lsp_H and Lsp_A */
+          tb_real NsnH_first_fail = (NsnH_first-NsnH_res)*(1-tpos_s);/* First line failure - split between Nsp_H and Nsp_A */
+          tb_real NsnH_second_success = NsnH_second*tpos_m;          /* Second line success - split between Lsp_H and Lsp_A */
+          tb_real NsnH_second_fail = NsnH_second*(1-tpos_m);         /* Second line failure - split between Nsp_H and Nsp_A */
 
           /* sm-, drug sus, previous Rx history */    
-          double NspH_pos = kpos*se_N_pos*rel_d*Nsp_H[i][j];        /* TB positive - move all out of Nsp_H */
-          double NspH_dst = NspH_pos*dstpos_p;                      /* Get DST */
-          double NspH_dst_fpos = NspH_dst*(1-sp_m_pos);             /* False pos on DST */
-          double NspH_first = l_s*(NspH_pos - NspH_dst_fpos);       /* Start first line Rx (correct) */     
-          double NspH_second = l_m*(NspH_dst_fpos);                 /* Start second line treatment (incorrect) */
-          double NspH_lost = NspH_pos - NspH_first - NspH_second;   /* Positive cases lost to follow up  - go to Nsp_H */ 
-          double NspH_res = NspH_first*e;                           /* Develop resistance - split between Nmp_H and Nmp_A */
-          double NspH_first_success = (NspH_first-NspH_res)*tpos_s; /* First line success - split between Lsp_H and Lsp_A */
-          double NspH_first_fail = (NspH_first-NspH_res)*(1-tpos_s);/* First line failure - split between Nsp_H and Nsp_A */
-          double NspH_second_success = NspH_second*tpos_m;          /* Second line success - split between Lsp_H and Lsp_A */
-          double NspH_second_fail = NspH_second*(1-tpos_m);         /* Second line failure - split between Nsp_H and Nsp_A */
+          tb_real NspH_pos = kpos*se_N_pos*rel_d*Nsp_H[i][j];        /* TB positive - move all out of Nsp_H */
+          tb_real NspH_dst = NspH_pos*dstpos_p;                      /* Get DST */
+          tb_real NspH_dst_fpos = NspH_dst*(1-sp_m_pos);             /* False pos on DST */
+          tb_real NspH_first = l_s*(NspH_pos - NspH_dst_fpos);       /* Start first line Rx (correct) */     
+          tb_real NspH_second = l_m*(NspH_dst_fpos);                 /* Start second line treatment (incorrect) */
+          tb_real NspH_lost = NspH_pos - NspH_first - NspH_second;   /* Positive cases lost to follow up  - go to Nsp_H */ 
+          tb_real NspH_res = NspH_first*e;                           /* Develop resistance - split between Nmp_H and Nmp_A */
+          tb_real NspH_first_success = (NspH_first-NspH_res)*tpos_s; /* First line success - split between Lsp_H and Lsp_A */
+          tb_real NspH_first_fail = (NspH_first-NspH_res)*(1-tpos_s);/* First line failure - split between Nsp_H and Nsp_A */
+          tb_real NspH_second_success = NspH_second*tpos_m;          /* Second line success - split between Lsp_H and Lsp_A */
+          tb_real NspH_second_fail = NspH_second*(1-tpos_m);         /* Second line failure - split between Nsp_H and Nsp_A */
 
           /* sm+, drug sus, no Rx history */    
-          double IsnH_pos = kpos*se_I_pos*Isn_H[i][j];              /* TB positive - move all out of Isn_H */
-          double IsnH_dst = IsnH_pos*dstpos_n;                      /* Get DST */
-          double IsnH_dst_fpos = IsnH_dst*(1-sp_m_pos);             /* False pos on DST */
-          double IsnH_first = l_s*(IsnH_pos - IsnH_dst_fpos);       /* Start first line Rx (correct) */     
-          double IsnH_second = l_m*(IsnH_dst_fpos);                 /* Start second line treatment (incorrect) */
-          double IsnH_lost = IsnH_pos - IsnH_first - IsnH_second;   /* Positive cases lost to follow up  - go to Isn_H */ 
-          double IsnH_res = IsnH_first*e;                           /* Develop resistance - split between Imp_H and Imp_A */
-          double IsnH_first_success = (IsnH_first-IsnH_res)*tpos_s; /* First line success - split between Lsp_H and Lsp_A */
-          double IsnH_first_fail = (IsnH_first-IsnH_res)*(1-tpos_s);/* First line failure - split between Isp_H and Isp_A */
-          double IsnH_second_success = IsnH_second*tpos_m;          /* Second line success - split between Lsp_H and Lsp_A */
-          double IsnH_second_fail = IsnH_second*(1-tpos_m);         /* Second line failure - split between Isp_H and Isp_A */
+          tb_real IsnH_pos = kpos*se_I_pos*Isn_H[i][j];              /* TB positive - move all out of Isn_H */
+          tb_real IsnH_dst = IsnH_pos*dstpos_n;                      /* Get DST */
+          tb_real IsnH_dst_fpos = IsnH_dst*(1-sp_m_pos);             /* False pos on DST */
+          tb_real IsnH_first = l_s*(IsnH_pos - IsnH_dst_fpos);       /* Start first line Rx (correct) */     
+          tb_real IsnH_second = l_m*(IsnH_dst_fpos);                 /* Start second line treatment (incorrect) */
+          tb_real IsnH_lost = IsnH_pos - IsnH_first - IsnH_second;   /* Positive cases lost to follow up  - go to Isn_H */ 
+          tb_real IsnH_res = IsnH_first*e;                           /* Develop resistance - split between Imp_H and Imp_A */
+          tb_real IsnH_first_success = (IsnH_first-IsnH_res)*tpos_s; /* First line success - split between Lsp_H and Lsp_A */
+          tb_real IsnH_first_fail = (IsnH_first-IsnH_res)*(1-tpos_s);/* First line failure - split between Isp_H and Isp_A */
+          tb_real IsnH_second_success = IsnH_second*tpos_m;          /* Second line success - split between Lsp_H and Lsp_A */
+          tb_real IsnH_second_fail = IsnH_second*(1-tpos_m);         /* Second line failure - split between Isp_H and Isp_A */
 
           /* sm+, drug sus, previous Rx history */    
-          double IspH_pos = kpos*se_I_pos*Isp_H[i][j];              /* TB positive - move all out of Isp_H */
-          double IspH_dst = IspH_pos*dstpos_p;                      /* Get DST */
-          double IspH_dst_fpos = IspH_dst*(1-sp_m_pos);             /* False pos on DST */
-          double IspH_first = l_s*(IspH_pos - IspH_dst_fpos);       /* Start first line Rx (correct) */     
-          double IspH_second = l_m*(IspH_dst_fpos);                 /* Start second line Rx (incorrect) */
-          double IspH_lost = IspH_pos - IspH_first - IspH_second;   /* Positive cases lost to follow up  - go to Isp_H */ 
-          double IspH_res = IspH_first*e;                           /* Develop resistance - split between Imp_H and Imp_A */
-          double IspH_first_success = (IspH_first-IspH_res)*tpos_s; /* First line success - split between Lsp_H and Lsp_A */
-          double IspH_first_fail = (IspH_first-IspH_res)*(1-tpos_s);/* First line failure - split between Isp_H and Isp_A */
-          double IspH_second_success = IspH_second*tpos_m;          /* Second line success - split between Lsp_H and Lsp_A*/
-          double IspH_second_fail = IspH_second*(1-tpos_m);         /* Second line failure - split between Isp_H and Isp_A */
+          tb_real IspH_pos = kpos*se_I_pos*Isp_H[i][j];              /* TB positive - move all out of Isp_H */
+          tb_real IspH_dst = IspH_pos*dstpos_p;                      /* Get DST */
+          tb_real IspH_dst_fpos = IspH_dst*(1-sp_m_pos);             /* False pos on DST */
+          tb_real IspH_first = l_s*(IspH_pos - IspH_dst_fpos);       /* Start first line Rx (correct) */     
+          tb_real IspH_second = l_m*(IspH_dst_fpos);                 /* Start second line Rx (incorrect) */
+          tb_real IspH_lost = IspH_pos - IspH_first - IspH_second;   /* Positive cases lost to follow up  - go to Isp_H */ 
+          tb_real IspH_res = IspH_first*e;                           /* Develop resistance - split between Imp_H and Imp_A */
+          tb_real IspH_first_success = (IspH_first-IspH_res)*tpos_s; /* First line success - split between Lsp_H and Lsp_A */
+          tb_real IspH_first_fail = (IspH_first-IspH_res)*(1-tpos_s);/* First line failure - split between Isp_H and Isp_A */
+          tb_real IspH_second_success = IspH_second*tpos_m;          /* Second line success - split between Lsp_H and Lsp_A*/
+          tb_real IspH_second_fail = IspH_second*(1-tpos_m);         /* Second line failure - split between Isp_H and Isp_A */
 
           /* sm-, MDR, no Rx history */
-          double NmnH_pos = kpos*se_N_pos*rel_d*Nmn_H[i][j];        /* TB positive - move all out of Nmn_H */
-          double NmnH_dst = NmnH_pos*dstpos_n;                      /* Get DST */
-          double NmnH_dst_pos = NmnH_dst*se_m_pos;                  /* True pos on DST */
-          double NmnH_first = l_s*(NmnH_pos - NmnH_dst_pos);        /* Start first line Rx (incorrect) */  
-          double NmnH_second = l_m*NmnH_dst_pos;                    /* Start second line Rx (correct) */
-          double NmnH_lost = NmnH_pos - NmnH_first - NmnH_second;   /* Positive cases lost to follow up - go to Nmn_H */
-          double NmnH_first_success = NmnH_first*tpos_s*eff_n;      /* First line success - split between Lmp_H and Lmp_A */
-          double NmnH_first_fail = NmnH_first - NmnH_first_success; /* First line failure - split between Nmp_H and Nmp_A */
-          double NmnH_second_success = NmnH_second*tpos_m;          /* Second line success - split between Lmp_H and Lmp_A */
-          double NmnH_second_fail = NmnH_second*(1-tpos_m);         /* Second line failure - split between Nmp_H and Nmp_A */
+          tb_real NmnH_pos = kpos*se_N_pos*rel_d*Nmn_H[i][j];        /* TB positive - move all out of Nmn_H */
+          tb_real NmnH_dst = NmnH_pos*dstpos_n;                      /* Get DST */
+          tb_real NmnH_dst_pos = NmnH_dst*se_m_pos;                  /* True pos on DST */
+          tb_real NmnH_first = l_s*(NmnH_pos - NmnH_dst_pos);        /* Start first line Rx (incorrect) */  
+          tb_real NmnH_second = l_m*NmnH_dst_pos;                    /* Start second line Rx (correct) */
+          tb_real NmnH_lost = NmnH_pos - NmnH_first - NmnH_second;   /* Positive cases lost to follow up - go to Nmn_H */
+          tb_real NmnH_first_success = NmnH_first*tpos_s*eff_n;      /* First line success - split between Lmp_H and Lmp_A */
+          tb_real NmnH_first_fail = NmnH_first - NmnH_first_success; /* First line failure - split between Nmp_H and Nmp_A */
+          tb_real NmnH_second_success = NmnH_second*tpos_m;          /* Second line success - split between Lmp_H and Lmp_A */
+          tb_real NmnH_second_fail = NmnH_second*(1-tpos_m);         /* Second line failure - split between Nmp_H and Nmp_A */
 
           /* sm-, MDR, previous Rx history */
-          double NmpH_pos = kpos*se_N_pos*rel_d*Nmp_H[i][j];        /* TB positive - move all out of Nmp */
-          double NmpH_dst = NmpH_pos*dstpos_p;                      /* Get DST */
-          double NmpH_dst_pos = NmpH_dst*se_m_pos;                  /* True pos on DST */
-          double NmpH_first = l_s*(NmpH_pos - NmpH_dst_pos);        /* Start first line Rx (incorrect) */  
-          double NmpH_second = l_m*NmpH_dst_pos;                    /* Start second line Rx (correct) */
-          double NmpH_lost = NmpH_pos - NmpH_first - NmpH_second;   /* Positive cases lost to follow up - go to Nmp */
-          double NmpH_first_success = NmpH_first*tpos_s*eff_p;      /* First line success - split between Lmp_H and Lmp_A */
-          double NmpH_first_fail = NmpH_first - NmpH_first_success; /* First line failure - split between Nmp_H and Nmp_A */
-          double NmpH_second_success = NmpH_second*tpos_m;          /* Second line success - split between Lmp_H and Lmp_A */
-          double NmpH_second_fail = NmpH_second*(1-tpos_m);         /* Second line failure - split between Nmp_H and Nmp_A */
+          tb_real NmpH_pos = kpos*se_N_pos*rel_d*Nmp_H[i][j];        /* TB positive - move all out of Nmp */
+          tb_real NmpH_dst = NmpH_pos*dstpos_p;                      /* Get DST */
+          tb_real NmpH_dst_pos = NmpH_dst*se_m_pos;                  /* True pos on DST */
+          tb_real NmpH_first = l_s*(NmpH_pos - NmpH_dst_pos);        /* Start first line Rx (incorrect) */  
+          tb_real NmpH_second = l_m*NmpH_dst_pos;                    /* Start second line Rx (correct) */
+          tb_real NmpH_lost = NmpH_pos - NmpH_first - NmpH_second;   /* Positive cases lost to follow up - go to Nmp */
+          tb_real NmpH_first_success = NmpH_first*tpos_s*eff_p;      /* First line success - split between Lmp_H and Lmp_A */
+          tb_real NmpH_first_fail = NmpH_first - NmpH_first_success; /* First line failure - split between Nmp_H and Nmp_A */
+          tb_real NmpH_second_success = NmpH_second*tpos_m;          /* Second line success - split between Lmp_H and Lmp_A */
+          tb_real NmpH_second_fail = NmpH_second*(1-tpos_m);         /* Second line failure - split between Nmp_H and Nmp_A */
 
           /* sm+, MDR, no Rx history */
-          double ImnH_pos = kpos*se_I_pos*Imn_H[i][j];              /* TB positive - move all out of Imn_A */
-          double ImnH_dst = ImnH_pos*dstpos_n;                      /* Get DST */
-          double ImnH_dst_pos = ImnH_dst*se_m_pos;                  /* True pos on DST */
-          double ImnH_first = l_s*(ImnH_pos - ImnH_dst_pos);        /* Start first line Rx (incorrect) */  
-          double ImnH_second = l_m*ImnH_dst_pos;                    /* Start second line Rx (correct) */
-          double ImnH_lost = ImnH_pos - ImnH_first - ImnH_second;   /* Positive cases lost to follow up - go to Imn_A */
-          double ImnH_first_success = ImnH_first*tpos_s*eff_n;      /* First line success - split between Lmp_H and Lmp_A */
-          double ImnH_first_fail = ImnH_first - ImnH_first_success; /* First line failure - split between Imp_H and Imp_A */
-          double ImnH_second_success = ImnH_second*tpos_m;          /* Second line success - split between Lmp_H and Lmp_A */
-          double ImnH_second_fail = ImnH_second*(1-tpos_m);         /* Second line failure - split between Imp_H and Imp_A */
+          tb_real ImnH_pos = kpos*se_I_pos*Imn_H[i][j];              /* TB positive - move all out of Imn_A */
+          tb_real ImnH_dst = ImnH_pos*dstpos_n;                      /* Get DST */
+          tb_real ImnH_dst_pos = ImnH_dst*se_m_pos;                  /* True pos on DST */
+          tb_real ImnH_first = l_s*(ImnH_pos - ImnH_dst_pos);        /* Start first line Rx (incorrect) */  
+          tb_real ImnH_second = l_m*ImnH_dst_pos;                    /* Start second line Rx (correct) */
+          tb_real ImnH_lost = ImnH_pos - ImnH_first - ImnH_second;   /* Positive cases lost to follow up - go to Imn_A */
+          tb_real ImnH_first_success = ImnH_first*tpos_s*eff_n;      /* First line success - split between Lmp_H and Lmp_A */
+          tb_real ImnH_first_fail = ImnH_first - ImnH_first_success; /* First line failure - split between Imp_H and Imp_A */
+          tb_real ImnH_second_success = ImnH_second*tpos_m;          /* Second line success - split between Lmp_H and Lmp_A */
+          tb_real ImnH_second_fail = ImnH_second*(1-tpos_m);         /* Second line failure - split between Imp_H and Imp_A */
 
           /* sm+, MDR, previous Rx history */
-          double ImpH_pos = kpos*se_I_pos*Imp_H[i][j];              /* TB positive - move all out of Imp_A */
-          double ImpH_dst = ImpH_pos*dstpos_p;                      /* Get DST */
-          double ImpH_dst_pos = ImpH_dst*se_m_pos;                  /* True pos on DST */
-          double ImpH_first = l_s*(ImpH_pos - ImpH_dst_pos);        /* Start first line Rx (incorrect) */  
-          double ImpH_second = l_m*ImpH_dst_pos;                    /* Start second line Rx (correct) */
-          double ImpH_lost = ImpH_pos - ImpH_first - ImpH_second;   /* Positive cases lost to follow up - go to Imp */
-          double ImpH_first_success = ImpH_first*tpos_s*eff_p;      /* First line success - split between Lmp_H and Lmp_A */
-          double ImpH_first_fail = ImpH_first - ImpH_first_success; /* First line failure - split between Imp_H and Imp_A */
-          double ImpH_second_success = ImpH_second*tpos_m;          /* Second line success - split between Lmp_H and Lmp_A */
-          double ImpH_second_fail = ImpH_second*(1-tpos_m);         /* Second line failure - split between Imp_H and Imp_A */
+          tb_real ImpH_pos = kpos*se_I_pos*Imp_H[i][j];              /* TB positive - move all out of Imp_A */
+          tb_real ImpH_dst = ImpH_pos*dstpos_p;                      /* Get DST */
+          tb_real ImpH_dst_pos = ImpH_dst*se_m_pos;                  /* True pos on DST */
+          tb_real ImpH_first = l_s*(ImpH_pos - ImpH_dst_pos);        /* Start first line Rx (incorrect) */  
+          tb_real ImpH_second = l_m*ImpH_dst_pos;                    /* Start second line Rx (correct) */
+          tb_real ImpH_lost = ImpH_pos - ImpH_first - ImpH_second;   /* Positive cases lost to follow up - go to Imp */
+          tb_real ImpH_first_success = ImpH_first*tpos_s*eff_p;      /* First line success - split between Lmp_H and Lmp_A */
+          tb_real ImpH_first_fail = ImpH_first - ImpH_first_success; /* First line failure - split between Imp_H and Imp_A */
+          tb_real ImpH_second_success = ImpH_second*tpos_m;          /* Second line success - split between Lmp_H and Lmp_A */
+          tb_real ImpH_second_fail = ImpH_second*(1-tpos_m);         /* Second line failure - split between Imp_H and Imp_A */
 
           dS_H[i][j] = - m_b[i]*S_H[i][j] - /* Death */
                       (FS + FM)*S_H[i][j] + /* Infection */
-                      forc[iz+82]*H_CD4[j][i]*S[i] - H_prog[j+1][i]*S_H[i][j] + H_prog[j][i]*S_H[i][j-1] - /* HIV incidence and progression */
+                      HIV_inc*H_CD4[j][i]*S[i] - H_prog[j+1][i]*S_H[i][j] + H_prog[j][i]*S_H[i][j-1] - /* HIV incidence and progression */
                       up_H_mort[j][i]*S_H[i][j] - ART_prop[i][j]*S_H[i][j] + (S_H[i][j]/tot_age[i])*(forc[iz+116]/5) - /* HIV death, ART inititation, migration */
                       false_pos*S_H[i][j]*HIV_ART; /* Link to ART for false positive TB cases */
 
           dLsn_H[i][j] = - m_b[i]*Lsn_H[i][j] + /* Death */
                         SH_to_LsnH + LmnH_to_LsnH + PTnH_to_LsnH - LsnH_to_LmnH - LsnH_to_NsnH - LsnH_to_IsnH - LsnH_to_NmnH - LsnH_to_ImnH + /* Infection and disease */
-                        forc[iz+82]*H_CD4[j][i]*Lsn[i] - H_prog[j+1][i]*Lsn_H[i][j] + H_prog[j][i]*Lsn_H[i][j-1] - /* HIV incidence and progression */ 
+                        HIV_inc*H_CD4[j][i]*Lsn[i] - H_prog[j+1][i]*Lsn_H[i][j] + H_prog[j][i]*Lsn_H[i][j-1] - /* HIV incidence and progression */ 
                         up_H_mort[j][i]*Lsn_H[i][j] - ART_prop[i][j]*Lsn_H[i][j] + (Lsn_H[i][j]/tot_age[i])*(forc[iz+116]/5) + r_H*(Isn_H[i][j] + Nsn_H[i][j]) - /* HIV death, ART inititation, migration, self_cure */
                         false_pos*Lsn_H[i][j]*(HIV_ART + (1-HIV_ART)*tpos_s); /* False positive for TB, ART and Rx */    
 
           dLsp_H[i][j] = - m_b[i]*Lsp_H[i][j] + /*Death */
                         LmpH_to_LspH + PTpH_to_LspH - LspH_to_LmpH - LspH_to_NspH - LspH_to_IspH  - LspH_to_NmpH - LspH_to_ImpH + /* Infection and disease */ 
                         (1-HIV_ART)*(NsnH_first_success + NsnH_second_success + NspH_first_success + NspH_second_success + IsnH_first_success + IsnH_second_success + IspH_first_success + IspH_second_success) + /* Rx */          
-                        forc[iz+82]*H_CD4[j][i]*Lsp[i] - H_prog[j+1][i]*Lsp_H[i][j] + H_prog[j][i]*Lsp_H[i][j-1] - /* HIV incidence and progression */
+                        HIV_inc*H_CD4[j][i]*Lsp[i] - H_prog[j+1][i]*Lsp_H[i][j] + H_prog[j][i]*Lsp_H[i][j-1] - /* HIV incidence and progression */
                         up_H_mort[j][i]*Lsp_H[i][j] - ART_prop[i][j]*Lsp_H[i][j] + (Lsp_H[i][j]/tot_age[i])*(forc[iz+116]/5) + r_H*(Isp_H[i][j]+Nsp_H[i][j]) - /* HIV death, ART inititation, migration, self-cure */
                         false_pos*Lsp_H[i][j]*(HIV_ART + (1-HIV_ART)*tpos_s); /* False positive for TB, ART and Rx */
 
           dLmn_H[i][j] = - m_b[i]*Lmn_H[i][j] + /* Death */
                         SH_to_LmnH + LsnH_to_LmnH + PTnH_to_LmnH - LmnH_to_LsnH - LmnH_to_NsnH - LmnH_to_IsnH - LmnH_to_NmnH - LmnH_to_ImnH - /* Infection and disease */ 
-                        forc[iz+82]*H_CD4[j][i]*Lmn[i] - H_prog[j+1][i]*Lmn_H[i][j] + H_prog[j][i]*Lmn_H[i][j-1] - /* HIV incidence and progression */
+                        HIV_inc*H_CD4[j][i]*Lmn[i] - H_prog[j+1][i]*Lmn_H[i][j] + H_prog[j][i]*Lmn_H[i][j-1] - /* HIV incidence and progression */
                         up_H_mort[j][i]*Lmn_H[i][j] - ART_prop[i][j]*Lmn_H[i][j] + (Lmn_H[i][j]/tot_age[i])*(forc[iz+116]/5) + r_H*(Imn_H[i][j]+Nmn_H[i][j]) - /* HIV death, ART inititation, migration, self-cure */
                         false_pos*Lmn_H[i][j]*HIV_ART; /* Link to ART for false positive TB cases */
      
           dLmp_H[i][j] = - m_b[i]*Lmp_H[i][j] + /* Death */
                         LspH_to_LmpH + PTpH_to_LmpH - LmpH_to_LspH - LmpH_to_NspH - LmpH_to_IspH - LmpH_to_NmpH - LmpH_to_ImpH + /* Infection and disease */
                         (1-HIV_ART)*(NmnH_first_success + NmnH_second_success + NmpH_first_success + NmpH_second_success + ImnH_first_success + ImnH_second_success + ImpH_first_success + ImpH_second_success) + /* Rx */ 
-                        forc[iz+82]*H_CD4[j][i]*Lmp[i] - H_prog[j+1][i]*Lmp_H[i][j] + H_prog[j][i]*Lmp_H[i][j-1] - /* HIV incidence and progression */
+                        HIV_inc*H_CD4[j][i]*Lmp[i] - H_prog[j+1][i]*Lmp_H[i][j] + H_prog[j][i]*Lmp_H[i][j-1] - /* HIV incidence and progression */
                         up_H_mort[j][i]*Lmp_H[i][j] - ART_prop[i][j]*Lmp_H[i][j] + (Lmp_H[i][j]/tot_age[i])*(forc[iz+116]/5) + r_H*(Imp_H[i][j]+Nmp_H[i][j]) - /* HIV death, ART inititation, migration, self-cure */
                         false_pos*Lmp_H[i][j]*HIV_ART; /* Link to ART for false positive TB cases */
 
           dNsn_H[i][j] = - m_b[i]*Nsn_H[i][j] + /* Death */
                         SH_to_NsnH + LsnH_to_NsnH + LmnH_to_NsnH + PTnH_to_NsnH - /* Disease */
                         NsnH_pos + NsnH_lost + /* Diagnosis, pre Rx lost */
-                        forc[iz+82]*H_CD4[j][i]*Nsn[i] - H_prog[j+1][i]*Nsn_H[i][j] + H_prog[j][i]*Nsn_H[i][j-1] - /* HIV incidence and progression */ 
+                        HIV_inc*H_CD4[j][i]*Nsn[i] - H_prog[j+1][i]*Nsn_H[i][j] + H_prog[j][i]*Nsn_H[i][j-1] - /* HIV incidence and progression */ 
                         up_H_mort[j][i]*Nsn_H[i][j] - ART_prop[i][j]*Nsn_H[i][j] + (Nsn_H[i][j]/tot_age[i])*(forc[iz+116]/5) - (theta_H + r_H + muN_H)*Nsn_H[i][j]; /* HIV death, ART inititation, migration, sm conversion, self-cure, TB death */
 
           dNsp_H[i][j] = - m_b[i]*Nsp_H[i][j] + /* Death */
                         LspH_to_NspH + LmpH_to_NspH + PTpH_to_NspH - /* Disease */
                         NspH_pos + NspH_lost + (1-HIV_ART)*(NsnH_first_fail + NsnH_second_fail + NspH_first_fail + NspH_second_fail) + /* Diagnosis, pre Rx lost, failed Rx */                     
-                        forc[iz+82]*H_CD4[j][i]*Nsp[i] - H_prog[j+1][i]*Nsp_H[i][j] + H_prog[j][i]*Nsp_H[i][j-1] - /* HIV incidence and progression */
+                        HIV_inc*H_CD4[j][i]*Nsp[i] - H_prog[j+1][i]*Nsp_H[i][j] + H_prog[j][i]*Nsp_H[i][j-1] - /* HIV incidence and progression */
                         up_H_mort[j][i]*Nsp_H[i][j] - ART_prop[i][j]*Nsp_H[i][j] + (Nsp_H[i][j]/tot_age[i])*(forc[iz+116]/5) -  (theta_H + r_H + muN_H)*Nsp_H[i][j]; /* HIV death, ART inititation, migration, sm conversion, self-cure, TB death */
     
           dNmn_H[i][j] = - m_b[i]*Nmn_H[i][j] + /* Death */
                         SH_to_NmnH + LsnH_to_NmnH + LmnH_to_NmnH + PTnH_to_NmnH - /* Disease */
                         NmnH_pos + NmnH_lost + /* Diagnosis, pre Rx lost */
-                        forc[iz+82]*H_CD4[j][i]*Nmn[i] - H_prog[j+1][i]*Nmn_H[i][j] + H_prog[j][i]*Nmn_H[i][j-1] - /* HIV incidence and progression */
+                        HIV_inc*H_CD4[j][i]*Nmn[i] - H_prog[j+1][i]*Nmn_H[i][j] + H_prog[j][i]*Nmn_H[i][j-1] - /* HIV incidence and progression */
                         up_H_mort[j][i]*Nmn_H[i][j] - ART_prop[i][j]*Nmn_H[i][j] + (Nmn_H[i][j]/tot_age[i])*(forc[iz+116]/5) - (theta_H + r_H + muN_H)*Nmn_H[i][j]; /* HIV death, ART inititation, migration, sm conversion, self-cure, TB death */
 
           dNmp_H[i][j] = - m_b[i]*Nmp_H[i][j] + /* Death */
                         LspH_to_NmpH + LmpH_to_NmpH + PTpH_to_NmpH - /* Disease */
                         NmpH_pos + NmpH_lost + (1-HIV_ART)*(NmnH_first_fail + NmnH_second_fail + NmpH_first_fail + NmpH_second_fail + NsnH_res + NspH_res) + /* Diagnosis, pre Rx lost, failed Rx, acquired resistance */                      
-                        forc[iz+82]*H_CD4[j][i]*Nmp[i] - H_prog[j+1][i]*Nmp_H[i][j] + H_prog[j][i]*Nmp_H[i][j-1] - /* HIV incidence and progression */ 
+                        HIV_inc*H_CD4[j][i]*Nmp[i] - H_prog[j+1][i]*Nmp_H[i][j] + H_prog[j][i]*Nmp_H[i][j-1] - /* HIV incidence and progression */ 
                         up_H_mort[j][i]*Nmp_H[i][j] - ART_prop[i][j]*Nmp_H[i][j] + (Nmp_H[i][j]/tot_age[i])*(forc[iz+116]/5) - (theta_H + r_H + muN_H)*Nmp_H[i][j]; /* HIV death, ART inititation, migration, sm conversion, self-cure, TB death */
 
           dIsn_H[i][j] = - m_b[i]*Isn_H[i][j] + /* Death */
                         SH_to_IsnH + LsnH_to_IsnH + LmnH_to_IsnH + PTnH_to_IsnH - /* Disease */
                         IsnH_pos + IsnH_lost + /* Diagnosis, pre Rx lost */
-                        forc[iz+82]*H_CD4[j][i]*Isn[i] - H_prog[j+1][i]*Isn_H[i][j] + H_prog[j][i]*Isn_H[i][j-1] - /* HIV incidence and progression */ 
+                        HIV_inc*H_CD4[j][i]*Isn[i] - H_prog[j+1][i]*Isn_H[i][j] + H_prog[j][i]*Isn_H[i][j-1] - /* HIV incidence and progression */ 
                         up_H_mort[j][i]*Isn_H[i][j] - ART_prop[i][j]*Isn_H[i][j] + (Isn_H[i][j]/tot_age[i])*(forc[iz+116]/5) + theta_H*Nsn_H[i][j] - (r_H + muI_H)*Isn_H[i][j]; /* HIV death, ART inititation, migration, sm conversion, self-cure, TB death */
 
           dIsp_H[i][j] = - m_b[i]*Isp_H[i][j] + /* Death */
                         LspH_to_IspH + LmpH_to_IspH + PTpH_to_IspH - /* Disease */  
                         IspH_pos + IspH_lost + (1-HIV_ART)*(IsnH_first_fail + IsnH_second_fail + IspH_first_fail + IspH_second_fail) + /* Diagnosis, pre Rx lost, failed Rx */
-                        forc[iz+82]*H_CD4[j][i]*Isp[i] - H_prog[j+1][i]*Isp_H[i][j] + H_prog[j][i]*Isp_H[i][j-1] - /* HIV incidence and progression */ 
+                        HIV_inc*H_CD4[j][i]*Isp[i] - H_prog[j+1][i]*Isp_H[i][j] + H_prog[j][i]*Isp_H[i][j-1] - /* HIV incidence and progression */ 
                         up_H_mort[j][i]*Isp_H[i][j] - ART_prop[i][j]*Isp_H[i][j] + (Isp_H[i][j]/tot_age[i])*(forc[iz+116]/5) + theta_H*Nsp_H[i][j] - (r_H + muI_H)*Isp_H[i][j]; /* HIV death, ART inititation, migration, sm conversion, self-cure, TB death */       
 
           dImn_H[i][j] = - m_b[i]*Imn_H[i][j] + /* Death */
                         SH_to_ImnH + LsnH_to_ImnH + LmnH_to_ImnH + PTnH_to_ImnH - /* Disease */
                         ImnH_pos + ImnH_lost + /* Diagnosis, pre Rx lost */
-                        forc[iz+82]*H_CD4[j][i]*Imn[i] - H_prog[j+1][i]*Imn_H[i][j] + H_prog[j][i]*Imn_H[i][j-1] - /* HIV incidence and progression */
+                        HIV_inc*H_CD4[j][i]*Imn[i] - H_prog[j+1][i]*Imn_H[i][j] + H_prog[j][i]*Imn_H[i][j-1] - /* HIV incidence and progression */
                         up_H_mort[j][i]*Imn_H[i][j] - ART_prop[i][j]*Imn_H[i][j] + (Imn_H[i][j]/tot_age[i])*(forc[iz+116]/5) + theta_H*Nmn_H[i][j] - (r_H + muI_H)*Imn_H[i][j]; /* HIV death, ART inititation, migration, sm conversion, self-cure, TB death */
 
           dImp_H[i][j] = - m_b[i]*Imp_H[i][j] + /* Death */
                         LspH_to_ImpH + LmpH_to_ImpH + PTpH_to_ImpH - /* Disease */
                         ImpH_pos + ImpH_lost + (1-HIV_ART)*(ImnH_first_fail + ImnH_second_fail + ImpH_first_fail + ImpH_second_fail + IsnH_res + IspH_res) + /* Diagnosis, pre Rx lost, failed Rx, acquired resistance */  
-                        forc[iz+82]*H_CD4[j][i]*Imp[i] - H_prog[j+1][i]*Imp_H[i][j] + H_prog[j][i]*Imp_H[i][j-1] - /* HIV incidence and progression */
+                        HIV_inc*H_CD4[j][i]*Imp[i] - H_prog[j+1][i]*Imp_H[i][j] + H_prog[j][i]*Imp_H[i][j-1] - /* HIV incidence and progression */
                         up_H_mort[j][i]*Imp_H[i][j] - ART_prop[i][j]*Imp_H[i][j] + (Imp_H[i][j]/tot_age[i])*(forc[iz+116]/5) + theta_H*Nmp_H[i][j] - (r_H + muI_H)*Imp_H[i][j]; /* HIV death, ART inititation, migration, sm conversion, self-cure, TB death */                        
                    
           dPTn_H[i][j] = -m_b[i]*PTn_H[i][j] - /* Death */
                          PTnH_to_LsnH - PTnH_to_NsnH - PTnH_to_IsnH - PTnH_to_LmnH - PTnH_to_NmnH - PTnH_to_ImnH + /* Infection and disease */
                          false_pos*(1-HIV_ART)*tpos_s*Lsn_H[i][j] - false_pos*PTn_H[i][j]*HIV_ART + /* Incorrect Rx for latent infected, linked to ART*/ 
-                         forc[iz+82]*H_CD4[j][i]*PTn[i] - H_prog[j+1][i]*PTn_H[i][j] + H_prog[j][i]*PTn_H[i][j-1] - /* HIV incidence and progression */ 
+                         HIV_inc*H_CD4[j][i]*PTn[i] - H_prog[j+1][i]*PTn_H[i][j] + H_prog[j][i]*PTn_H[i][j-1] - /* HIV incidence and progression */ 
                          up_H_mort[j][i]*PTn_H[i][j] - ART_prop[i][j]*PTn_H[i][j] + (PTn_H[i][j]/tot_age[i])*(forc[iz+116]/5); /* HIV death, ART inititation, migration */
 
           dPTp_H[i][j] = - m_b[i]*PTp_H[i][j] - /* Death */
                          PTpH_to_LspH - PTpH_to_NspH - PTpH_to_IspH - PTpH_to_LmpH - PTpH_to_NmpH - PTpH_to_ImpH + /* Infection and disease */
                          false_pos*(1-HIV_ART)*tpos_s*Lsp_H[i][j] - false_pos*PTp_H[i][j]*HIV_ART + /* Incorrect Rx for latent infected, linked to ART*/
-                         forc[iz+82]*H_CD4[j][i]*PTp[i] - H_prog[j+1][i]*PTp_H[i][j] + H_prog[j][i]*PTp_H[i][j-1] - /* HIV incidence and progression */
+                         HIV_inc*H_CD4[j][i]*PTp[i] - H_prog[j+1][i]*PTp_H[i][j] + H_prog[j][i]*PTp_H[i][j-1] - /* HIV incidence and progression */
                          up_H_mort[j][i]*PTp_H[i][j] - ART_prop[i][j]*PTp_H[i][j] + (PTp_H[i][j]/tot_age[i])*(forc[iz+116]/5); /* HIV death, ART inititation, migration */
                            
           TB_cases_pos_age[i][j] =(v_age_H[i][j]*(1-sig_H) + FS*a_age_H[i][j]*(1-p_H[j])*(1-sig_H))*Lsn_H[i][j] + FS*a_age_H[i][j]*(1-sig_H)*(S_H[i][j] + (1-p_H[j])*(Lmn_H[i][j] + PTn_H[i][j])) + 
@@ -1358,164 +1689,162 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
                                   (v_age_H[i][j]*sig_H + FM*a_age_H[i][j]*sig_H*(1-p_H[j]))*Lmn_H[i][j] + FM*a_age_H[i][j]*sig_H*(S_H[i][j] + (1-p_H[j])*(Lsn_H[i][j] + PTn_H[i][j]))+
                                   (v_age_H[i][j]*sig_H + FM*a_age_H[i][j]*sig_H*(1-p_H[j]))*Lmp_H[i][j] + FM*a_age_H[i][j]*sig_H*(1-p_H[j])*(Lsp_H[i][j] + PTp_H[i][j]);
 
-          TB_cases_pos = TB_cases_pos + TB_cases_pos_age[i][j];
-          
           TB_cases_age[i] = TB_cases_age[i] + TB_cases_pos_age[i][j];
        
        /* HIV+ on ART: loop through time on ART, CD4 at initiation, age */
           
-          if(ART_all > 0.0){  /* if no ART yet can skip these */
+          if(tb_re(ART_all) > 0.0){  /* if no ART yet can skip these */
           
           for (l=0; l<n_ART; l++){
         
               /* Calculate the disease flows here and use these in the derivatives - intention is to make the model more flexible/easier to understand */
       
-            double SA_to_LsnA = FS*(1-a_age_A[i][j][l])*S_A[i][j][l];                                /* Susceptible to latent DS infection (no disease history) */
-            double SA_to_NsnA = FS*a_age_A[i][j][l]*(1-sig_H)*S_A[i][j][l];                          /* Susceptible to primary DS smear negative disease (no disease history) */
-            double SA_to_IsnA = FS*a_age_A[i][j][l]*sig_H*S_A[i][j][l];                              /* Susceptible to primary DS smear positive disease (no disease history) */
-            double SA_to_LmnA = FM*(1-a_age_A[i][j][l])*S_A[i][j][l];                                /* Susceptible to latent DR infection (no disease history) */
-            double SA_to_NmnA = FM*a_age_A[i][j][l]*(1-sig_H)*S_A[i][j][l];                          /* Susceptible to primary DR smear negative disease (no disease history) */
-            double SA_to_ImnA = FM*a_age_A[i][j][l]*sig_H*S_A[i][j][l];                              /* Susceptible to primary DR smear positive disease (no disease history) */
+            tb_real SA_to_LsnA = FS*(1-a_age_A[i][j][l])*S_A[i][j][l];                                /* Susceptible to latent DS infection (no disease history) */
+            tb_real SA_to_NsnA = FS*a_age_A[i][j][l]*(1-sig_H)*S_A[i][j][l];                          /* Susceptible to primary DS smear negative disease (no disease history) */
+            tb_real SA_to_IsnA = FS*a_age_A[i][j][l]*sig_H*S_A[i][j][l];                              /* Susceptible to primary DS smear positive disease (no disease history) */
+            tb_real SA_to_LmnA = FM*(1-a_age_A[i][j][l])*S_A[i][j][l];                                /* Susceptible to latent DR infection (no disease history) */
+            tb_real SA_to_NmnA = FM*a_age_A[i][j][l]*(1-sig_H)*S_A[i][j][l];                          /* Susceptible to primary DR smear negative disease (no disease history) */
+            tb_real SA_to_ImnA = FM*a_age_A[i][j][l]*sig_H*S_A[i][j][l];                              /* Susceptible to primary DR smear positive disease (no disease history) */
       
-            double LsnA_to_NsnA = (v_age_A[i][j][l] + FS*a_age_A[i][j][l]*(1-p_A[j][l]))*(1-sig_H)*Lsn_A[i][j][l];   /* Latent DS to smear negative DS disease (no disease history) - reactivation and reinfection */ 
-            double LsnA_to_IsnA = (v_age_A[i][j][l] + FS*a_age_A[i][j][l]*(1-p_A[j][l]))*sig_H*Lsn_A[i][j][l];       /* Latent DS to smear positive DS disease (no disease history) - reactivation and reinfection */ 
-            double LsnA_to_NmnA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*Lsn_A[i][j][l];                        /* Latent DS to smear negative DR disease (no disease history) - co-infection */ 
-            double LsnA_to_ImnA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*Lsn_A[i][j][l];                            /* Latent DS to smear positive DR disease (no disease history) - co-infection */
-            double LsnA_to_LmnA = FM*(1-a_age_A[i][j][l])*(1-p_A[j][l])*g*Lsn_A[i][j][l];                            /* Latent DS to latent DR (no disease history) */
+            tb_real LsnA_to_NsnA = (v_age_A[i][j][l] + FS*a_age_A[i][j][l]*(1-p_A[j][l]))*(1-sig_H)*Lsn_A[i][j][l];   /* Latent DS to smear negative DS disease (no disease history) - reactivation and reinfection */ 
+            tb_real LsnA_to_IsnA = (v_age_A[i][j][l] + FS*a_age_A[i][j][l]*(1-p_A[j][l]))*sig_H*Lsn_A[i][j][l];       /* Latent DS to smear positive DS disease (no disease history) - reactivation and reinfection */ 
+            tb_real LsnA_to_NmnA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*Lsn_A[i][j][l];                        /* Latent DS to smear negative DR disease (no disease history) - co-infection */ 
+            tb_real LsnA_to_ImnA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*Lsn_A[i][j][l];                            /* Latent DS to smear positive DR disease (no disease history) - co-infection */
+            tb_real LsnA_to_LmnA = FM*(1-a_age_A[i][j][l])*(1-p_A[j][l])*g*Lsn_A[i][j][l];                            /* Latent DS to latent DR (no disease history) */
       
-            double LmnA_to_NmnA = (v_age_A[i][j][l] + FM*a_age_A[i][j][l]*(1-p_A[j][l]))*(1-sig_H)*Lmn_A[i][j][l];   /* Latent DR to smear negative DR disease (no disease history) - reactivation and reinfection */ 
-            double LmnA_to_ImnA = (v_age_A[i][j][l] + FM*a_age_A[i][j][l]*(1-p_A[j][l]))*sig_H*Lmn_A[i][j][l];       /* Latent DR to smear positive DR disease (no disease history) - reactivation and reinfection */ 
-            double LmnA_to_NsnA = FS*a_age_A[i][j][l]*(1-sig_H)*(1-p_A[j][l])*Lmn_A[i][j][l];                        /* Latent DR to smear negative DS disease (no disease history) - co-infection */
-            double LmnA_to_IsnA = FS*a_age_A[i][j][l]*sig_H*(1-p_A[j][l])*Lmn_A[i][j][l];                            /* Latent DR to smear positive DS disease (no disease history) - co-infection */
-            double LmnA_to_LsnA = FS*(1-a_age_A[i][j][l])*(1-p_A[j][l])*(1-g)*Lmn_A[i][j][l];                        /* Latent DR to latent DS (no disease history) */
-
-            double LspA_to_NspA = (v_age_A[i][j][l] + FS*a_age_A[i][j][l]*(1-p_A[j][l]))*(1-sig_H)*Lsp_A[i][j][l];   /* Latent DS to smear negative DS disease (prior Rx) - reactivation and reinfection */ 
-            double LspA_to_IspA = (v_age_A[i][j][l] + FS*a_age_A[i][j][l]*(1-p_A[j][l]))*sig_H*Lsp_A[i][j][l];       /* Latent DS to smear positive DS disease (prior Rx) - reactivation and reinfection */     
-            double LspA_to_NmpA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*Lsp_A[i][j][l];                        /* Latent DS to smear negative DR disease (prior_rx) - reactivation and reinfection */ 
-            double LspA_to_ImpA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*Lsp_A[i][j][l];                            /* Latent DS to smear positive DR disease (prior_Rx) - reactivation and reinfection */
-            double LspA_to_LmpA = FM*(1-a_age_A[i][j][l])*(1-p_A[j][l])*g*Lsp_A[i][j][l];                            /* Latent DS to latent DR (prior Rx) */
+            tb_real LmnA_to_NmnA = (v_age_A[i][j][l] + FM*a_age_A[i][j][l]*(1-p_A[j][l]))*(1-sig_H)*Lmn_A[i][j][l];   /* Latent DR to smear negative DR disease (no disease history) - reactivation and reinfection */ 
+            tb_real LmnA_to_ImnA = (v_age_A[i][j][l] + FM*a_age_A[i][j][l]*(1-p_A[j][l]))*sig_H*Lmn_A[i][j][l];       /* Latent DR to smear positive DR disease (no disease history) - reactivation and reinfection */ 
+            tb_real LmnA_to_NsnA = FS*a_age_A[i][j][l]*(1-sig_H)*(1-p_A[j][l])*Lmn_A[i][j][l];                        /* Latent DR to smear negative DS disease (no disease history) - co-infection */
+            tb_real LmnA_to_IsnA = FS*a_age_A[i][j][l]*sig_H*(1-p_A[j][l])*Lmn_A[i][j][l];                            /* Latent DR to smear positive DS disease (no disease history) - co-infection */
+            tb_real LmnA_to_LsnA = FS*(1-a_age_A[i][j][l])*(1-p_A[j][l])*(1-g)*Lmn_A[i][j][l];                        /* Latent DR to latent DS (no disease history) */
+
+            tb_real LspA_to_NspA = (v_age_A[i][j][l] + FS*a_age_A[i][j][l]*(1-p_A[j][l]))*(1-sig_H)*Lsp_A[i][j][l];   /* Latent DS to smear negative DS disease (prior Rx) - reactivation and reinfection */ 
+            tb_real LspA_to_IspA = (v_age_A[i][j][l] + FS*a_age_A[i][j][l]*(1-p_A[j][l]))*sig_H*Lsp_A[i][j][l];       /* Latent DS to smear positive DS disease (prior Rx) - reactivation and reinfection */     
+            tb_real LspA_to_NmpA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*Lsp_A[i][j][l];                        /* Latent DS to smear negative DR disease (prior_rx) - reactivation and reinfection */ 
+            tb_real LspA_to_ImpA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*Lsp_A[i][j][l];                            /* Latent DS to smear positive DR disease (prior_Rx) - reactivation and reinfection */
+            tb_real LspA_to_LmpA = FM*(1-a_age_A[i][j][l])*(1-p_A[j][l])*g*Lsp_A[i][j][l];                            /* Latent DS to latent DR (prior Rx) */
       
-            double LmpA_to_NmpA = (v_age_A[i][j][l] + FM*a_age_A[i][j][l]*(1-p_A[j][l]))*(1-sig_H)*Lmp_A[i][j][l];   /* Latent DR to smear negative DR disease (prior Rx) - reactivation and reinfection */ 
-            double LmpA_to_ImpA = (v_age_A[i][j][l] + FM*a_age_A[i][j][l]*(1-p_A[j][l]))*sig_H*Lmp_A[i][j][l];       /* Latent DR to smear positive DR disease (prior Rx) - reactivation and reinfection */     
-            double LmpA_to_NspA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*Lmp_A[i][j][l];                        /* Latent DR to smear negative DS disease (prior_rx) - reactivation and reinfection */ 
-            double LmpA_to_IspA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*Lmp_A[i][j][l];                            /* Latent DR to smear positive DS disease (prior_Rx) - reactivation and reinfection */
-            double LmpA_to_LspA = FS*(1-a_age_A[i][j][l])*(1-p_A[j][l])*(1-g)*Lmp_A[i][j][l];                        /* Latent DR to latent DS (prior Rx) */
+            tb_real LmpA_to_NmpA = (v_age_A[i][j][l] + FM*a_age_A[i][j][l]*(1-p_A[j][l]))*(1-sig_H)*Lmp_A[i][j][l];   /* Latent DR to smear negative DR disease (prior Rx) - reactivation and reinfection */ 
+            tb_real LmpA_to_ImpA = (v_age_A[i][j][l] + FM*a_age_A[i][j][l]*(1-p_A[j][l]))*sig_H*Lmp_A[i][j][l];       /* Latent DR to smear positive DR disease (prior Rx) - reactivation and reinfection */     
+            tb_real LmpA_to_NspA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*Lmp_A[i][j][l];                        /* Latent DR to smear negative DS disease (prior_rx) - reactivation and reinfection */ 
+            tb_real LmpA_to_IspA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*Lmp_A[i][j][l];                            /* Latent DR to smear positive DS disease (prior_Rx) - reactivation and reinfection */
+            tb_real LmpA_to_LspA = FS*(1-a_age_A[i][j][l])*(1-p_A[j][l])*(1-g)*Lmp_A[i][j][l];                        /* Latent DR to latent DS (prior Rx) */
             
-            double PTnA_to_LsnA = FS*(1-a_age_A[i][j][l])*(1-p_A[j][l])*PTn_A[i][j][l];            /* Post PT to latent DS (no disease history) */
-            double PTnA_to_NsnA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*PTn_A[i][j][l];      /* Post PT to smear negative DS disease (no disease history) */
-            double PTnA_to_IsnA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*PTn_A[i][j][l];          /* Post PT to smear positive DS disease (no disease history) */
-            double PTnA_to_LmnA = FM*(1-a_age_A[i][j][l])*(1-p_A[j][l])*g*PTn_A[i][j][l];          /* Post PT to latent DR (no disease history) */
-            double PTnA_to_NmnA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*PTn_A[i][j][l];      /* Post PT to smear negative DR disease (no disease history) */
-            double PTnA_to_ImnA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*PTn_A[i][j][l];          /* Post PT to smear positive DR disease (no disease history) */
+            tb_real PTnA_to_LsnA = FS*(1-a_age_A[i][j][l])*(1-p_A[j][l])*PTn_A[i][j][l];            /* Post PT to latent DS (no disease history) */
+            tb_real PTnA_to_NsnA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*PTn_A[i][j][l];      /* Post PT to smear negative DS disease (no disease history) */
+            tb_real PTnA_to_IsnA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*PTn_A[i][j][l];          /* Post PT to smear positive DS disease (no disease history) */
+            tb_real PTnA_to_LmnA = FM*(1-a_age_A[i][j][l])*(1-p_A[j][l])*g*PTn_A[i][j][l];          /* Post PT to latent DR (no disease history) */
+            tb_real PTnA_to_NmnA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*PTn_A[i][j][l];      /* Post PT to smear negative DR disease (no disease history) */
+            tb_real PTnA_to_ImnA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*PTn_A[i][j][l];          /* Post PT to smear positive DR disease (no disease history) */
       
-            double PTpA_to_LspA = FS*(1-a_age_A[i][j][l])*(1-p_A[j][l])*PTp_A[i][j][l];            /* Post PT to latent DS (prior Rx) */
-            double PTpA_to_NspA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*PTp_A[i][j][l];      /* Post PT to smear negative DS disease (prior Rx) */
-            double PTpA_to_IspA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*PTp_A[i][j][l];          /* Post PT to smear positive DS disease (prior Rx) */
-            double PTpA_to_LmpA = FM*(1-a_age_A[i][j][l])*(1-p_A[j][l])*g*PTp_A[i][j][l];          /* Post PT to latent DR (prior Rx) */
-            double PTpA_to_NmpA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*PTp_A[i][j][l];      /* Post PT to smear negative DR disease (prior Rx) */
-            double PTpA_to_ImpA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*PTp_A[i][j][l];          /* Post PT to smear positive DR disease (prior Rx) */
+            tb_real PTpA_to_LspA = FS*(1-a_age_A[i][j][l])*(1-p_A[j][l])*PTp_A[i][j][l];            /* Post PT to latent DS (prior Rx) */
+            tb_real PTpA_to_NspA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*PTp_A[i][j][l];      /* Post PT to smear negative DS disease (prior Rx) */
+            tb_real PTpA_to_IspA = FS*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*PTp_A[i][j][l];          /* Post PT to smear positive DS disease (prior Rx) */
+            tb_real PTpA_to_LmpA = FM*(1-a_age_A[i][j][l])*(1-p_A[j][l])*g*PTp_A[i][j][l];          /* Post PT to latent DR (prior Rx) */
+            tb_real PTpA_to_NmpA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*(1-sig_H)*PTp_A[i][j][l];      /* Post PT to smear negative DR disease (prior Rx) */
+            tb_real PTpA_to_ImpA = FM*a_age_A[i][j][l]*(1-p_A[j][l])*sig_H*PTp_A[i][j][l];          /* Post PT to smear positive DR disease (prior Rx) */
         
             /* Calculate "care" flows here and use these in the derivatives */
             
             /* sm-, drug sus, no Rx history */    
-            double NsnA_pos = kpos*se_N_pos*rel_d*Nsn_A[i][j][l];     /* TB positive - move all out of Nsn_A */
-            double NsnA_dst = NsnA_pos*dstpos_n;                      /* Get DST */
-            double NsnA_dst_fpos = NsnA_dst*(1-sp_m_pos);             /* False pos on DST */
-            double NsnA_first = l_s*(NsnA_pos - NsnA_dst_fpos);       /* Start first line Rx (correct) */     
-            double NsnA_second = l_m*(NsnA_dst_fpos);                 /* Start second line treatment (incorrect) */
-            double NsnA_lost = NsnA_pos - NsnA_first - NsnA_second;   /* Positive cases lost to follow up  - go to Nsn_A */ 
-            double NsnA_res = NsnA_first*e;                           /* Develop resistance - go to Nmp_A */
-            double NsnA_first_success = (NsnA_first-NsnA_res)*tART_s; /* First line success - go to Lsp_A */
-            double NsnA_first_fail = (NsnA_first-NsnA_res)*(1-tART_s);/* First line failure - go to Nsp_A */
-            double NsnA_second_success = NsnA_second*tART_m;          /* Second line success - go to Lsp_A */
-            double NsnA_second_fail = NsnA_second*(1-tART_m);         /* Second line failure - go to Nsp_A */
+            tb_real NsnA_pos = kpos*se_N_pos*rel_d*Nsn_A[i][j][l];     /* TB positive - move all out of Nsn_A */
+            tb_real NsnA_dst = NsnA_pos*dstpos_n;                      /* Get DST */
+            tb_real NsnA_dst_fpos = NsnA_dst*(1-sp_m_pos);             /* False pos on DST */
+            tb_real NsnA_first = l_s*(NsnA_pos - NsnA_dst_fpos);       /* Start first line Rx (correct) */     
+            tb_real NsnA_second = l_m*(NsnA_dst_fpos);                 /* Start second line treatment (incorrect) */
+            tb_real NsnA_lost = NsnA_pos - NsnA_first - NsnA_second;   /* Positive cases lost to follow up  - go to Nsn_A */ 
+            tb_real NsnA_res = NsnA_first*e;                           /* Develop resistance - go to Nmp_A */
+            tb_real NsnA_first_success = (NsnA_first-NsnA_res)*tART_s; /* First line success - go to Lsp_A */
+            tb_real NsnA_first_fail = (NsnA_first-NsnA_res)*(1-tART_s);/* First line failure - go to Nsp_A */
+            tb_real NsnA_second_success = NsnA_second*tART_m;          /* Second line success - go to Lsp_A */
+            tb_real NsnA_second_fail = NsnA_second*(1-tART_m);         /* Second line failure - go to Nsp_A */
 
             /* sm-, drug sus, previous Rx history */    
-            double NspA_pos = kpos*se_N_pos*rel_d*Nsp_A[i][j][l];     /* TB positive - move all out of Nsp_A */
-            double NspA_dst = NspA_pos*dstpos_p;                      /* Get DST */
-            double NspA_dst_fpos = NspA_dst*(1-sp_m_pos);             /* False pos on DST */
-            double NspA_first = l_s*(NspA_pos - NspA_dst_fpos);       /* Start first line Rx (correct) */     
-            double NspA_second = l_m*(NspA_dst_fpos);                 /* Start second line treatment (incorrect) */
-            double NspA_lost = NspA_pos - NspA_first - NspA_second;   /* Positive cases lost to follow up  - go to Nsp_A */ 
-            double NspA_res = NspA_first*e;                           /* Develop resistance - go to Nmp_A */
-            double NspA_first_success = (NspA_first-NspA_res)*tART_s; /* First line success - go to Lsp_A */
-            double NspA_first_fail = (NspA_first-NspA_res)*(1-tART_s);/* First line failure - go to Nsp_A */
-            double NspA_second_success = NspA_second*tART_m;          /* Second line success - go to Lsp_A */
-            double NspA_second_fail = NspA_second*(1-tART_m);         /* Second line failure - go to Nsp_A */
+            tb_real NspA_pos = kpos*se_N_pos*rel_d*Nsp_A[i][j][l];     /* TB positive - move all out of Nsp_A */
+            tb_real NspA_dst = NspA_pos*dstpos_p;                      /* Get DST */
+            tb_real NspA_dst_fpos = NspA_dst*(1-sp_m_pos);             /* False pos on DST */
+            tb_real NspA_first = l_s*(NspA_pos - NspA_dst_fpos);       /* Start first line Rx (correct) */     
+            tb_real NspA_second = l_m*(NspA_dst_fpos);                 /* Start second line treatment (incorrect) */
+            tb_real NspA_lost = NspA_pos - NspA_first - NspA_second;   /* Positive cases lost to follow up  - go to Nsp_A */ 
+            tb_real NspA_res = NspA_first*e;                           /* Develop resistance - go to Nmp_A */
+            tb_real NspA_first_success = (NspA_first-NspA_res)*tART_s; /* First line success - go to Lsp_A */
+            tb_real NspA_first_fail = (NspA_first-NspA_res)*(1-tART_s);/* First line failure - go to Nsp_A */
+            tb_real NspA_second_success = NspA_second*tART_m;          /* Second line success - go to Lsp_A */
+            tb_real NspA_second_fail = NspA_second*(1-tART_m);         /* Second line failure - go to Nsp_A */
 
             /* sm+, drug sus, no Rx history */    
-            double IsnA_pos = kpos*se_I_pos*Isn_A[i][j][l];           /* TB positive - move all out of Isn_A */
-            double IsnA_dst = IsnA_pos*dstpos_n;                      /* Get DST */
-            double IsnA_dst_fpos = IsnA_dst*(1-sp_m_pos);             /* False pos on DST */
-            double IsnA_first = l_s*(IsnA_pos - IsnA_dst_fpos);       /* Start first line Rx (correct) */     
-            double IsnA_second = l_m*(IsnA_dst_fpos);                 /* Start second line treatment (incorrect) */
-            double IsnA_lost = IsnA_pos - IsnA_first - IsnA_second;   /* Positive cases lost to follow up  - go to Isn_A */ 
-            double IsnA_res = IsnA_first*e;                           /* Develop resistance - go to Imp_A */
-            double IsnA_first_success = (IsnA_first-IsnA_res)*tART_s; /* First line success - go to Lsp_A */
-            double IsnA_first_fail = (IsnA_first-IsnA_res)*(1-tART_s);/* First line failure - go to Isp_A */
-            double IsnA_second_success = IsnA_second*tART_m;          /* Second line success - go to Lsp_A */
-            double IsnA_second_fail = IsnA_second*(1-tART_m);         /* Second line failure - go to Isp_A */
+            tb_real IsnA_pos = kpos*se_I_pos*Isn_A[i][j][l];           /* TB positive - move all out of Isn_A */
+            tb_real IsnA_dst = IsnA_pos*dstpos_n;                      /* Get DST */
+            tb_real IsnA_dst_fpos = IsnA_dst*(1-sp_m_pos);             /* False pos on DST */
+            tb_real IsnA_first = l_s*(IsnA_pos - IsnA_dst_fpos);       /* Start first line Rx (correct) */     
+            tb_real IsnA_second = l_m*(IsnA_dst_fpos);                 /* Start second line treatment (incorrect) */
+            tb_real IsnA_lost = IsnA_pos - IsnA_first - IsnA_second;   /* Positive cases lost to follow up  - go to Isn_A */ 
+            tb_real IsnA_res = IsnA_first*e;                           /* Develop resistance - go to Imp_A */
+            tb_real IsnA_first_success = (IsnA_first-IsnA_res)*tART_s; /* First line success - go to Lsp_A */
+            tb_real IsnA_first_fail = (IsnA_first-IsnA_res)*(1-tART_s);/* First line failure - go to Isp_A */
+            tb_real IsnA_second_success = IsnA_second*tART_m;          /* Second line success - go to Lsp_A */
+            tb_real IsnA_second_fail = IsnA_second*(1-tART_m);         /* Second line failure - go to Isp_A */
 
             /* sm+, drug sus, previous Rx history */    
-            double IspA_pos = kpos*se_I_pos*Isp_A[i][j][l];           /* TB positive - move all out of Isp_A */
-            double IspA_dst = IspA_pos*dstpos_p;                      /* Get DST */
-            double IspA_dst_fpos = IspA_dst*(1-sp_m_pos);             /* False pos on DST */
-            double IspA_first = l_s*(IspA_pos - IspA_dst_fpos);       /* Start first line Rx (correct) */     
-            double IspA_second = l_m*(IspA_dst_fpos);                 /* Start second line Rx (incorrect) */
-            double IspA_lost = IspA_pos - IspA_first - IspA_second;   /* Positive cases lost to follow up  - go to Isp_A */ 
-            double IspA_res = IspA_first*e;                           /* Develop resistance - go to Imp_A */
-            double IspA_first_success = (IspA_first-IspA_res)*tART_s; /* First line success - go to Lsp_A */
-            double IspA_first_fail = (IspA_first-IspA_res)*(1-tART_s);/* First line failure - go to Isp_A */
-            double IspA_second_success = IspA_second*tART_m;          /* Second line success - go to Lsp_A */
-            double IspA_second_fail = IspA_second*(1-tART_m);         /* Second line failure - go to Isp_A */
+            tb_real IspA_pos = kpos*se_I_pos*Isp_A[i][j][l];           /* TB positive - move all out of Isp_A */
+            tb_real IspA_dst = IspA_pos*dstpos_p;                      /* Get DST */
+            tb_real IspA_dst_fpos = IspA_dst*(1-sp_m_pos);             /* False pos on DST */
+            tb_real IspA_first = l_s*(IspA_pos - IspA_dst_fpos);       /* Start first line Rx (correct) */     
+            tb_real IspA_second = l_m*(IspA_dst_fpos);                 /* Start second line Rx (incorrect) */
+            tb_real IspA_lost = IspA_pos - IspA_first - IspA_second;   /* Positive cases lost to follow up  - go to Isp_A */ 
+            tb_real IspA_res = IspA_first*e;                           /* Develop resistance - go to Imp_A */
+            tb_real IspA_first_success = (IspA_first-IspA_res)*tART_s; /* First line success - go to Lsp_A */
+            tb_real IspA_first_fail = (IspA_first-IspA_res)*(1-tART_s);/* First line failure - go to Isp_A */
+            tb_real IspA_second_success = IspA_second*tART_m;          /* Second line success - go to Lsp_A */
+            tb_real IspA_second_fail = IspA_second*(1-tART_m);         /* Second line failure - go to Isp_A */
 
             /* sm-, MDR, no Rx history */
-            double NmnA_pos = kpos*se_N_pos*rel_d*Nmn_A[i][j][l];     /* TB positive - move all out of Nmn_A */
-            double NmnA_dst = NmnA_pos*dstpos_n;                      /* Get DST */
-            double NmnA_dst_pos = NmnA_dst*se_m_pos;                  /* True pos on DST */
-            double NmnA_first = l_s*(NmnA_pos - NmnA_dst_pos);        /* Start first line Rx (incorrect) */  
-            double NmnA_second = l_m*NmnA_dst_pos;                    /* Start second line Rx (correct) */
-            double NmnA_lost = NmnA_pos - NmnA_first - NmnA_second;   /* Positive cases lost to follow up - go to Nmn_A */
-            double NmnA_first_success = NmnA_first*tART_s*eff_n;      /* First line success - go to Lmp_A */
-            double NmnA_first_fail = NmnA_first - NmnA_first_success; /* First line failure - go to Nmp_A */
-            double NmnA_second_success = NmnA_second*tART_m;          /* Second line success - go to Lmp_A */
-            double NmnA_second_fail = NmnA_second*(1-tART_m);         /* Second line failure - go to Nmp_A */
+            tb_real NmnA_pos = kpos*se_N_pos*rel_d*Nmn_A[i][j][l];     /* TB positive - move all out of Nmn_A */
+            tb_real NmnA_dst = NmnA_pos*dstpos_n;                      /* Get DST */
+            tb_real NmnA_dst_pos = NmnA_dst*se_m_pos;                  /* True pos on DST */
+            tb_real NmnA_first = l_s*(NmnA_pos - NmnA_dst_pos);        /* Start first line Rx (incorrect) */  
+            tb_real NmnA_second = l_m*NmnA_dst_pos;                    /* Start second line Rx (correct) */
+            tb_real NmnA_lost = NmnA_pos - NmnA_first - NmnA_second;   /* Positive cases lost to follow up - go to Nmn_A */
+            tb_real NmnA_first_success = NmnA_first*tART_s*eff_n;      /* First line success - go to Lmp_A */
+            tb_real NmnA_first_fail = NmnA_first - NmnA_first_success; /* First line failure - go to Nmp_A */
+            tb_real NmnA_second_success = NmnA_second*tART_m;          /* Second line success - go to Lmp_A */
+            tb_real NmnA_second_fail = NmnA_second*(1-tART_m);         /* Second line failure - go to Nmp_A */
 
             /* sm-, MDR, previous Rx history */
-            double NmpA_pos = kpos*se_N_pos*rel_d*Nmp_A[i][j][l];     /* TB positive - move all out of Nmp_A */
-            double NmpA_dst = NmpA_pos*dstpos_p;                      /* Get DST */
-            double NmpA_dst_pos = NmpA_dst*se_m_pos;                  /* True pos on DST */
-            double NmpA_first = l_s*(NmpA_pos - NmpA_dst_pos);        /* Start first line Rx (incorrect) */  
-            double NmpA_second = l_m*NmpA_dst_pos;                    /* Start second line Rx (correct) */
-            double NmpA_lost = NmpA_pos - NmpA_first - NmpA_second;   /* Positive cases lost to follow up - go to Nmp_A */
-            double NmpA_first_success = NmpA_first*tART_s*eff_p;      /* First line success - go to Lmp_A */
-            double NmpA_first_fail = NmpA_first - NmpA_first_success; /* First line failure - go to Nmp_A */
-            double NmpA_second_success = NmpA_second*tART_m;          /* Second line success - go to Lmp_A */
-            double NmpA_second_fail = NmpA_second*(1-tART_m);         /* Second line failure - go to Nmp_A */
+            tb_real NmpA_pos = kpos*se_N_pos*rel_d*Nmp_A[i][j][l];     /* TB positive - move all out of Nmp_A */
+            tb_real NmpA_dst = NmpA_pos*dstpos_p;                      /* Get DST */
+            tb_real NmpA_dst_pos = NmpA_dst*se_m_pos;                  /* True pos on DST */
+            tb_real NmpA_first = l_s*(NmpA_pos - NmpA_dst_pos);        /* Start first line Rx (incorrect) */  
+            tb_real NmpA_second = l_m*NmpA_dst_pos;                    /* Start second line Rx (correct) */
+            tb_real NmpA_lost = NmpA_pos - NmpA_first - NmpA_second;   /* Positive cases lost to follow up - go to Nmp_A */
+            tb_real NmpA_first_success = NmpA_first*tART_s*eff_p;      /* First line success - go to Lmp_A */
+            tb_real NmpA_first_fail = NmpA_first - NmpA_first_success; /* First line failure - go to Nmp_A */
+            tb_real NmpA_second_success = NmpA_second*tART_m;          /* Second line success - go to Lmp_A */
+            tb_real NmpA_second_fail = NmpA_second*(1-tART_m);         /* Second line failure - go to Nmp_A */
 
             /* sm+, MDR, no Rx history */
-            double ImnA_pos = kpos*se_I_pos*Imn_A[i][j][l];           /* TB positive - move all out of Imn_A */
-            double ImnA_dst = ImnA_pos*dstpos_n;                      /* Get DST */
-            double ImnA_dst_pos = ImnA_dst*se_m_pos;                  /* True pos on DST */
-            double ImnA_first = l_s*(ImnA_pos - ImnA_dst_pos);        /* Start first line Rx (incorrect) */  
-            double ImnA_second = l_m*ImnA_dst_pos;                    /* Start second line Rx (correct) */
-            double ImnA_lost = ImnA_pos - ImnA_first - ImnA_second;   /* Positive cases lost to follow up - go to Imn_A */
-            double ImnA_first_success = ImnA_first*tART_s*eff_n;      /* First line success - go to Lmp_A */
-            double ImnA_first_fail = ImnA_first - ImnA_first_success; /* First line failure - go to Imp_A */
-            double ImnA_second_success = ImnA_second*tART_m;          /* Second line success - go to Lmp_A */
-            double ImnA_second_fail = ImnA_second*(1-tART_m);         /* Second line failure - go to Imp_A */
+            tb_real ImnA_pos = kpos*se_I_pos*Imn_A[i][j][l];           /* TB positive - move all out of Imn_A */
+            tb_real ImnA_dst = ImnA_pos*dstpos_n;                      /* Get DST */
+            tb_real ImnA_dst_pos = ImnA_dst*se_m_pos;                  /* True pos on DST */
+            tb_real ImnA_first = l_s*(ImnA_pos - ImnA_dst_pos);        /* Start first line Rx (incorrect) */  
+            tb_real ImnA_second = l_m*ImnA_dst_pos;                    /* Start second line Rx (correct) */
+            tb_real ImnA_lost = ImnA_pos - ImnA_first - ImnA_second;   /* Positive cases lost to follow up - go to Imn_A */
+            tb_real ImnA_first_success = ImnA_first*tART_s*eff_n;      /* First line success - go to Lmp_A */
+            tb_real ImnA_first_fail = ImnA_first - ImnA_first_success; /* First line failure - go to Imp_A */
+            tb_real ImnA_second_success = ImnA_second*tART_m;          /* Second line success - go to Lmp_A */
+            tb_real ImnA_second_fail = ImnA_second*(1-tART_m);         /* Second line failure - go to Imp_A */
 
             /* sm+, MDR, previous Rx history */
-            double ImpA_pos = kpos*se_I_pos*Imp_A[i][j][l];           /* TB positive - move all out of Imp_A */
-            double ImpA_dst = ImpA_pos*dstpos_p;                      /* Get DST */
-            double ImpA_dst_pos = ImpA_dst*se_m_pos;                  /* True pos on DST */
-            double ImpA_first = l_s*(ImpA_pos - ImpA_dst_pos);        /* Start first line Rx (incorrect) */  
-            double ImpA_second = l_m*ImpA_dst_pos;                    /* Start second line Rx (correct) */
-            double ImpA_lost = ImpA_pos - ImpA_first - ImpA_second;   /* Positive cases lost to follow up - go to Imp_A */
-            double ImpA_first_success = ImpA_first*tART_s*eff_p;      /* First line success - go to Lmp_A */
-            double ImpA_first_fail = ImpA_first - ImpA_first_success; /* First line failure - go to Imp_A */
-            double ImpA_second_success = ImpA_second*tART_m;          /* Second line success - go to Lmp_A */
-            double ImpA_second_fail = ImpA_second*(1-tART_m);         /* Second line failure - go to Imp_A */
+            tb_real ImpA_pos = kpos*se_I_pos*Imp_A[i][j][l];           /* TB positive - move all out of Imp_A */
+            tb_real ImpA_dst = ImpA_pos*dstpos_p;                      /* Get DST */
+            tb_real ImpA_dst_pos = ImpA_dst*se_m_pos;                  /* True pos on DST */
+            tb_real ImpA_first = l_s*(ImpA_pos - ImpA_dst_pos);        /* Start first line Rx (incorrect) */  
+            tb_real ImpA_second = l_m*ImpA_dst_pos;                    /* Start second line Rx (correct) */
+            tb_real ImpA_lost = ImpA_pos - ImpA_first - ImpA_second;   /* Positive cases lost to follow up - go to Imp_A */
+            tb_real ImpA_first_success = ImpA_first*tART_s*eff_p;      /* First line success - go to Lmp_A */
+            tb_real ImpA_first_fail = ImpA_first - ImpA_first_success; /* First line failure - go to Imp_A */
+            tb_real ImpA_second_success = ImpA_second*tART_m;          /* Second line success - go to Lmp_A */
+            tb_real ImpA_second_fail = ImpA_second*(1-tART_m);         /* Second line failure - go to Imp_A */
         
 
         
@@ -1627,8 +1956,6 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
                                       (v_age_A[i][j][l]*sig_H + FM*a_age_A[i][j][l]*sig_H*(1-p_A[j][l]))*Lmn_A[i][j][l] + FM*a_age_A[i][j][l]*sig_H*(S_A[i][j][l] + (1-p_A[j][l])*(Lsn_A[i][j][l] + PTn_A[i][j][l])) +
                                       (v_age_A[i][j][l]*sig_H + FM*a_age_A[i][j][l]*sig_H*(1-p_A[j][l]))*Lmp_A[i][j][l] + FM*a_age_A[i][j][l]*sig_H*(1-p_A[j][l])*(Lsp_A[i][j][l] + PTp_A[i][j][l]);
 
-            TB_cases_ART = TB_cases_ART + TB_cases_ART_age[i][j][l];
-        
             TB_cases_age[i] = TB_cases_age[i] + TB_cases_ART_age[i][j][l];
         
           }  /* end loop on ART */
@@ -1637,78 +1964,103 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
         }    /* end if on HIV equations */
     }        /* end loop on age */
 
+    /* Total new cases (added up here rather than in the loop so they don't depend on the number of threads) */
+    for (i=0; i<n_age; i++){
+      TB_cases_neg = TB_cases_neg + TB_cases_neg_age[i];
+      if (tb_re(HIV_run)>0.0){
+        for (j=0; j<n_HIV; j++){
+          TB_cases_pos = TB_cases_pos + TB_cases_pos_age[i][j];
+          if (tb_re(ART_all) > 0.0){
+            for (l=0; l<n_ART; l++) TB_cases_ART = TB_cases_ART + TB_cases_ART_age[i][j][l];
+          }
+        }
+      }
+    }
+
+#ifdef NO_PT
+    /* No post PT states - fold their rates of change back into the latent states they came from (PT states are zero so this is just the false positive Rx flows) */
+    for (i=0; i<n_age; i++){
+      dLsn[i] = dLsn[i] + dPTn[i];
+      dLsp[i] = dLsp[i] + dPTp[i];
+      for (j=0; j<n_HIV; j++){
+        dLsn_H[i][j] = dLsn_H[i][j] + dPTn_H[i][j];
+        dLsp_H[i][j] = dLsp_H[i][j] + dPTp_H[i][j];
+        for (l=0; l<n_ART; l++){
+          dLsn_A[i][j][l] = dLsn_A[i][j][l] + dPTn_A[i][j][l];
+          dLsp_A[i][j][l] = dLsp_A[i][j][l] + dPTp_A[i][j][l];
+        }
+      }
+    }
+#endif
+
     /* Put our calculated rates of change back into ydot */
 
+    /* HIV- */
+    for (k=0; k<15; k++){
+      if (slot[k]>=0) for (i=0; i<n_age; i++) ydot[slot[k]*n_age+i] = dX[k][i];
+    }
     /* HIV+ */
-    for (i=0; i<n_age; i++) ydot[i] = dS[i];             
-    for (i=n_age; i<n_age*2; i++) ydot[i] = dLsn[i-n_age];      
-    for (i=n_age*2; i<n_age*3; i++) ydot[i] = dLsp[i-n_age*2];    /* Lsp: 34-50 */
-    for (i=n_age*3; i<n_age*4; i++) ydot[i] = dLmn[i-n_age*3];    /* Lmn: 51-67 */
-    for (i=n_age*4; i<n_age*5; i++) ydot[i] = dLmp[i-n_age*4];    /* Lmp: 68-84 */
-    for (i=n_age*5; i<n_age*6; i++) ydot[i] = dNsn[i-n_age*5];    /* Nsn: 85-101 */
-    for (i=n_age*6; i<n_age*7; i++) ydot[i] = dNsp[i-n_age*6];    /* Nsp: 102-118 */
-    for (i=n_age*7; i<n_age*8; i++) ydot[i] = dNmn[i-n_age*7];    /* Nmn: 119-135 */
-    for (i=n_age*8; i<n_age*9; i++) ydot[i] = dNmp[i-n_age*8];    /* Nmp: 136-152 */ 
-    for (i=n_age*9; i<n_age*10; i++) ydot[i] = dIsn[i-n_age*9];   /* Isn: 153-169 */
-    for (i=n_age*10; i<n_age*11; i++) ydot[i] = dIsp[i-n_age*10]; /* Isp: 170-186 */
-    for (i=n_age*11; i<n_age*12; i++) ydot[i] = dImn[i-n_age*11]; /* Imn: 187-203 */
-    for (i=n_age*12; i<n_age*13; i++) ydot[i] = dImp[i-n_age*12]; /* Imp: 204-220 */
-    for (i=n_age*13; i<n_age*14; i++) ydot[i] = dPTn[i-n_age*13]; /* Imn: 187-203 */
-    for (i=n_age*14; i<n_age*15; i++) ydot[i] = dPTp[i-n_age*14]; /* Imp: 204-220 */
-    
-    /* HIV+ */
-    ij = n_age*n_disease;                                     
+    ij = n_age*n_disease;
     for (j=0; j<n_HIV; j++){
       for (i=0; i<n_age; i++){  
-        ydot[ij] = dS_H[i][j];
-        ydot[ij+(n_age*n_HIV)] = dLsn_H[i][j];
-        ydot[ij+(2*n_age*n_HIV)] = dLsp_H[i][j]; 
-        ydot[ij+(3*n_age*n_HIV)] = dLmn_H[i][j];
-        ydot[ij+(4*n_age*n_HIV)] = dLmp_H[i][j];  
-        ydot[ij+(5*n_age*n_HIV)] = dNsn_H[i][j];
-        ydot[ij+(6*n_age*n_HIV)] = dNsp_H[i][j];
-        ydot[ij+(7*n_age*n_HIV)] = dNmn_H[i][j];
-        ydot[ij+(8*n_age*n_HIV)] = dNmp_H[i][j];
-        ydot[ij+(9*n_age*n_HIV)] = dIsn_H[i][j];
-        ydot[ij+(10*n_age*n_HIV)] = dIsp_H[i][j];
-        ydot[ij+(11*n_age*n_HIV)] = dImn_H[i][j];
-        ydot[ij+(12*n_age*n_HIV)] = dImp_H[i][j];
-        ydot[ij+(13*n_age*n_HIV)] = dPTn_H[i][j];
-        ydot[ij+(14*n_age*n_HIV)] = dPTp_H[i][j];
+        for (k=0; k<15; k++){
+          if (slot[k]>=0) ydot[ij+(slot[k]*n_age*n_HIV)] = dX_H[k][i][j];
+        }
         ij = ij+1;
       }
     }
     /* HIV+, on ART */
-    ij = (n_HIV+1)*n_disease*n_age;   
+    ij = (n_HIV+1)*n_age*n_disease;
     for (l=0; l<n_ART; l++){                          
       for (j=0; j<n_HIV; j++){
         for (i=0; i<n_age; i++){
-          ydot[ij] = dS_A[i][j][l];
-          ydot[ij+(n_age*n_ART*n_HIV)] = dLsn_A[i][j][l];
-          ydot[ij+(2*n_age*n_ART*n_HIV)] = dLsp_A[i][j][l];
-          ydot[ij+(3*n_age*n_ART*n_HIV)] = dLmn_A[i][j][l];
-          ydot[ij+(4*n_age*n_ART*n_HIV)] = dLmp_A[i][j][l];  
-          ydot[ij+(5*n_age*n_ART*n_HIV)] = dNsn_A[i][j][l];
-          ydot[ij+(6*n_age*n_ART*n_HIV)] = dNsp_A[i][j][l];
-          ydot[ij+(7*n_age*n_ART*n_HIV)] = dNmn_A[i][j][l];
-          ydot[ij+(8*n_age*n_ART*n_HIV)] = dNmp_A[i][j][l];
-          ydot[ij+(9*n_age*n_ART*n_HIV)] = dIsn_A[i][j][l];
-          ydot[ij+(10*n_age*n_ART*n_HIV)] = dIsp_A[i][j][l];
-          ydot[ij+(11*n_age*n_ART*n_HIV)] = dImn_A[i][j][l];
-          ydot[ij+(12*n_age*n_ART*n_HIV)] = dImp_A[i][j][l];
-          ydot[ij+(13*n_age*n_ART*n_HIV)] = dPTn_A[i][j][l];
-          ydot[ij+(14*n_age*n_ART*n_HIV)] = dPTp_A[i][j][l];
+          for (k=0; k<15; k++){
+            if (slot[k]>=0) ydot[ij+(slot[k]*n_age*n_ART*n_HIV)] = dX_A[k][i][j][l];
+          }
           ij = ij+1;
         }
       }
     }
     
+    /* Continuous aging and births (see AGING above) */
+    if (tb_aging){
+      int n_model = n_age*n_disease*(1+n_HIV+n_HIV*n_ART);
+      for (ij=0; ij<n_model; ij+=n_age){
+        for (i=n_age-1; i>0; i--) ydot[ij+i] = ydot[ij+i] + y[ij+i-1] - (i<n_age-1 ? y[ij+i] : 0);
+        ydot[ij] = ydot[ij] - y[ij];
+      }
+      ydot[0] = ydot[0] + births;
+    }
+
+    /* Split mode - take the demography out of the rates of change and/or store its rates (see OPERATOR SPLITTING above) */
+    if (tb_split || split_get){
+      int n_model = n_age*n_disease*(1+n_HIV+n_HIV*n_ART);
+      for (i=0; i<n_age; i++){
+        tb_real q = (tb_re(tot_age[i])>0.0 ? (forc[iii[i]+116]/5)/tot_age[i] : 0) - m_b[i];
+        tb_real h = HIV_ON*forc[iii[i]+82];
+        if (split_get){
+          split_q[i] = tb_re(q);
+          split_h[i] = tb_re(h);
+          for (j=0; j<n_HIV; j++) split_cd4[i][j] = tb_re(H_CD4[j][i]);
+        }
+        if (tb_split){
+          for (ij=i; ij<n_model; ij+=n_age) ydot[ij] = ydot[ij] - q*y[ij];
+          for (k=0; k<n_disease; k++){
+            ydot[k*n_age+i] = ydot[k*n_age+i] + h*y[k*n_age+i];
+            for (j=0; j<n_HIV; j++){
+              ydot[n_age*n_disease+k*n_age*n_HIV+j*n_age+i] = ydot[n_age*n_disease+k*n_age*n_HIV+j*n_age+i] - h*H_CD4[j][i]*y[k*n_age+i];
+            }
+          }
+        }
+      }
+    }
+
     /* Calculate notifications, treatments etc */
-    double DS_correct = 0;
-    double DS_incorrect = 0; 
-    double MDR_correct = 0; 
-    double MDR_incorrect = 0;
-    double FP = 0; 
+    tb_real DS_correct = 0;
+    tb_real DS_incorrect = 0; 
+    tb_real MDR_correct = 0; 
+    tb_real MDR_incorrect = 0;
+    tb_real FP = 0; 
     
     for (i=0; i<n_age; i++){
     
@@ -1801,8 +2153,8 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
     yout[10] = Total_I;
     yout[11] = Total_DS;
     yout[12] = Total_MDR;
-    yout[13] = FS*100;
-    yout[14] = FM*100;
+    yout[13] = FS_all*100;
+    yout[14] = FM_all*100;
     yout[15] = CD4_dist_all[0];
     yout[16] = CD4_dist_all[1];
     yout[17] = CD4_dist_all[2];
@@ -1831,5 +2183,488 @@ void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
     yout[40] = MDR_incorrect;
     yout[41] = FP;
 
+    if (acc > 0){
+      tb_real flows[N_ACC] = {TB_cases_neg, TB_cases_pos, TB_cases_ART, TB_deaths_neg_tot, TB_deaths_pos_tot,
+                              tb_sumsum(HIV_deaths_HIV,0,80) + tb_sumsum(HIV_deaths_ART,0,80), Tot_deaths,
+                              DS_correct, DS_incorrect, MDR_correct, MDR_incorrect, FP};
+      for (k=0; k<N_ACC; k++){
+        ydot[acc+k] = flows[k];
+        ydot[acc+N_ACC+k] = 0;
+      }
+    }
+
+}
+
+/* ###### DERIVATIVE FUNCTION CALLED BY deSolve ###### */
+
+#if !defined(TB_COMPLEX_STEP) && !defined(TB_FLOAT)
+void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip)
+{
+    model_check(neq, ip, parms);
+    model_kernel(neq, t, y, ydot, yout, ip, parms, forc, NULL);
+}
+#else
+/* Complex step and single precision builds - the state, parameters and forcings are copied to tb_real for the model and the */
+/* rates of change and outputs copied back (the real part). For complex step this is slower than the normal build (it is here so */
+/* derivs1 still works) */
+static tb_real *cast_y = NULL, *cast_ydot = NULL, *cast_out = NULL;
+static int cast_n = 0, cast_nout = 0;
+
+void derivs1(int *neq, double *t, double *y, double *ydot, double *yout, int *ip)
+{
+    int i;
+    tb_real pc[404], fc[166];
+    if (*neq > cast_n){
+      cast_y = (tb_real *) realloc(cast_y, (*neq)*sizeof(tb_real));
+      cast_ydot = (tb_real *) realloc(cast_ydot, (*neq)*sizeof(tb_real));
+      cast_n = *neq;
+    }
+    if (ip[0] > cast_nout){
+      cast_out = (tb_real *) realloc(cast_out, ip[0]*sizeof(tb_real));
+      cast_nout = ip[0];
+    }
+    if (cast_y==NULL || cast_ydot==NULL || cast_out==NULL) error("couldn't allocate memory for the model state");
+    for (i=0; i<404; i++) pc[i] = parms[i];
+    for (i=0; i<166; i++) fc[i] = forc[i];
+    for (i=0; i<*neq; i++) cast_y[i] = y[i];
+    for (i=0; i<ip[0]; i++) cast_out[i] = 0;
+    model_check(neq, ip, pc);
+    model_kernel(neq, t, cast_y, cast_ydot, cast_out, ip, pc, fc, NULL);
+    for (i=0; i<*neq; i++) ydot[i] = tb_re(cast_ydot[i]);
+    for (i=0; i<ip[0]; i++) yout[i] = tb_re(cast_out[i]);
+}
+#endif
+
+#ifdef TB_COMPLEX_STEP
+
+/* Exact directional derivative (J*dir) of the rates of change and outputs at state y with parameters p_in (404) and forcings f_in (166) */
+/* The direction is dir for the state plus entries as in set_sens: type 0 adds w to p_in[idx], type 1 scales f_in[idx] by (1+w) */
+/* Called from R with .C("jvp_cs", neq, t, y, dir, p_in, f_in, n_ent, type, idx, w, nout, jv=double(neq), jout=double(nout), PACKAGE="TB_model_cs") */
+void jvp_cs(int *neq, double *t, double *y, double *dir, double *p_in, double *f_in, int *n_ent, int *type, int *idx, double *w,
+            int *nout, double *jv, double *jout)
+{
+    int i, j;
+    double h = 1e-20;
+    int ip[1];
+    tb_real *yc = (tb_real *) R_alloc(*neq, sizeof(tb_real));
+    tb_real *ydc = (tb_real *) R_alloc(*neq, sizeof(tb_real));
+    tb_real *yoc = (tb_real *) R_alloc(*nout, sizeof(tb_real));
+    tb_real pc[404], fc[166];
+    
+    ip[0] = *nout;
+    for (i=0; i<404; i++) pc[i] = p_in[i];
+    for (i=0; i<166; i++) fc[i] = f_in[i];
+    for (j=0; j<*n_ent; j++){
+      if (type[j]==0 && idx[j]>=0 && idx[j]<404) pc[idx[j]] = pc[idx[j]] + I*h*w[j];
+      else if (type[j]==1 && idx[j]>=0 && idx[j]<166) fc[idx[j]] = fc[idx[j]]*(1 + I*h*w[j]);
+      else error("direction entry %d is out of range", j+1);
+    }
+    for (i=0; i<*neq; i++) yc[i] = y[i] + I*h*dir[i];
+    for (i=0; i<*nout; i++) yoc[i] = 0;
+    model_check(neq, ip, pc);
+    model_kernel(neq, t, yc, ydc, yoc, ip, pc, fc, NULL);
+    for (i=0; i<*neq; i++) jv[i] = cimag(ydc[i])/h;
+    for (i=0; i<*nout; i++) jout[i] = cimag(yoc[i])/h;
+}
+#endif
+
+/* ###### FORWARD SENSITIVITIES - d(state)/d(par) AND d(output)/d(par) INTEGRATED ALONGSIDE THE MODEL (see Sensitivity.R) ###### */
+
+/* The state passed to derivs_sens/event_sens is the model state (n values) followed by n_sens blocks of n sensitivities */
+/* Each sensitivity block k follows dS/dt = J*S + df/dpar, which is the derivative of f along (S, par) - this is calculated */
+/* with one extra call to derivs1 per block (a forward difference), so a run costs about (n_sens+1) times a normal run */
+/* Each "par" is a direction in parameter space made up of entries - type 0 adds w to parms[idx], type 1 scales forc[idx] by (1+w), */
+/* type 2 adds w to forc[idx] at time tk falling linearly to 0 at tk-dt and tk+dt (the value of the forcing function at a knot) */
+/* so a parameter that others are calculated from (e.g. a_a -> a0, a5, a10) is one direction with several entries */
+
+/* Not in the complex step or single precision builds - the forward differences need the model in double precision */
+/* (the step is sqrt(DBL_EPSILON), below the precision of the single precision model) */
+#if !defined(TB_COMPLEX_STEP) && !defined(TB_FLOAT)
+#define MAX_SENS 20       /* Maximum number of sensitivity directions */
+#define MAX_SENS_ENT 200  /* Maximum total number of entries */
+
+static int n_sens = 0;
+static int n_sens_ent = 0;
+static int sens_k[MAX_SENS_ENT];      /* direction each entry belongs to */
+static int sens_type[MAX_SENS_ENT];   /* 0 = parameter, 1 = forcing scaling, 2 = forcing knot */
+static int sens_idx[MAX_SENS_ENT];    /* index into parms or forc */
+static double sens_w[MAX_SENS_ENT];   /* weight */
+static double sens_tk[MAX_SENS_ENT];  /* knot time and half width (type 2 only) */
+static double sens_dt[MAX_SENS_ENT];
+
+static double *sens_y = NULL;         /* work space - perturbed state, rates of change and outputs */
+static double *sens_f = NULL;
+static double *sens_out = NULL;
+static int sens_n = 0;
+static int sens_nout = 0;
+
+/* Called from R with .C("set_sens", K, n_ent, k, type, idx, w, tk, dt) before a run with derivs_sens (k and idx start at 0) */
+void set_sens(int *K, int *n_ent, int *k, int *type, int *idx, double *w, double *tk, double *dt)
+{
+    int j;
+    if (*K<0 || *K>MAX_SENS) error("number of sensitivity directions must be between 0 and %d", MAX_SENS);
+    if (*n_ent<0 || *n_ent>MAX_SENS_ENT) error("too many sensitivity entries (max %d)", MAX_SENS_ENT);
+    for (j=0; j<*n_ent; j++){
+      if (k[j]<0 || k[j]>=*K) error("sensitivity entry %d has direction %d out of range", j+1, k[j]);
+      if (type[j]==0 && (idx[j]<0 || idx[j]>=404)) error("sensitivity entry %d has parameter index %d out of range", j+1, idx[j]);
+      if (type[j]>0 && (idx[j]<0 || idx[j]>=166)) error("sensitivity entry %d has forcing index %d out of range", j+1, idx[j]);
+      if (type[j]<0 || type[j]>2) error("sensitivity entry %d has unknown type %d", j+1, type[j]);
+      if (type[j]==2 && dt[j]<=0) error("sensitivity entry %d has a knot width <= 0", j+1);
+      sens_k[j] = k[j];
+      sens_type[j] = type[j];
+      sens_idx[j] = idx[j];
+      sens_w[j] = w[j];
+      sens_tk[j] = tk[j];
+      sens_dt[j] = dt[j];
+    }
+    n_sens = *K;
+    n_sens_ent = *n_ent;
+}
+
+/* Weight of an entry at time t - only knots (type 2) change with time */
+static double sens_weight(int j, double t)
+{
+    if (sens_type[j]!=2) return sens_w[j];
+    return sens_w[j]*fmax(0.0, 1.0 - fabs(t - sens_tk[j])/sens_dt[j]);
 }
 
+void derivs_sens(int *neq, double *t, double *y, double *ydot, double *yout, int *ip)
+{
+    int n = *neq/(n_sens+1);
+    int nout = ip[0]/(n_sens+1);
+    int i, j, k;
+    double h, hp, y_max, s_max;
+    double old[MAX_SENS_ENT];
+    double w[MAX_SENS_ENT];
+    
+    for (j=0; j<n_sens_ent; j++) w[j] = sens_weight(j, *t);
+    
+    if (n*(n_sens+1) != *neq) error("number of states isn't a multiple of the number of sensitivity directions + 1");
+    if (nout*(n_sens+1) != ip[0]) error("nout isn't a multiple of the number of sensitivity directions + 1");
+    
+    if (n > sens_n){
+      sens_y = (double *) realloc(sens_y, n*sizeof(double));
+      sens_f = (double *) realloc(sens_f, n*sizeof(double));
+      sens_n = n;
+    }
+    if (ip[0] > sens_nout){
+      sens_out = (double *) realloc(sens_out, ip[0]*sizeof(double));
+      sens_nout = ip[0];
+    }
+    if (sens_y==NULL || sens_f==NULL || sens_out==NULL) error("couldn't allocate memory for sensitivities");
+    
+    /* The model itself */
+    derivs1(&n, t, y, ydot, yout, ip);
+    
+    y_max = 0;
+    for (i=0; i<n; i++) y_max = fmax(y_max, fabs(y[i]));
+    
+    for (k=0; k<n_sens; k++){
+      
+      double *S = y + (k+1)*n;
+      double *dS = ydot + (k+1)*n;
+      
+      /* Step size - small relative to both the state and the parameters */
+      s_max = 0;
+      for (i=0; i<n; i++) s_max = fmax(s_max, fabs(S[i]));
+      h = s_max>0 ? sqrt(DBL_EPSILON)*(1+y_max)/s_max : 1.0;
+      int n_ent_k = 0;
+      for (j=0; j<n_sens_ent; j++){
+        if (sens_k[j]!=k || w[j]==0) continue;
+        n_ent_k++;
+        if (sens_type[j]==0) hp = sqrt(DBL_EPSILON)*fmax(fabs(parms[sens_idx[j]]),1e-3)/fabs(w[j]);
+        else if (sens_type[j]==1) hp = sqrt(DBL_EPSILON)/fabs(w[j]);
+        else hp = sqrt(DBL_EPSILON)*fmax(fabs(forc[sens_idx[j]]),1e-3)/fabs(w[j]);
+        h = fmin(h, hp);
+      }
+      
+      /* Nothing to propagate yet (no sensitivity and no parameters in this direction) */
+      if (s_max==0 && n_ent_k==0){
+        for (i=0; i<n; i++) dS[i] = 0;
+        for (i=0; i<nout; i++) yout[(k+1)*nout+i] = 0;
+        continue;
+      }
+      
+      /* Perturb the state and parameters/forcings, call the model, then put the parameters/forcings back */
+      for (i=0; i<n; i++) sens_y[i] = y[i] + h*S[i];
+      for (j=0; j<n_sens_ent; j++){
+        if (sens_k[j]!=k) continue;
+        if (sens_type[j]==0){
+          old[j] = parms[sens_idx[j]];
+          parms[sens_idx[j]] = parms[sens_idx[j]] + h*w[j];
+        }
+        else if (sens_type[j]==1){
+          old[j] = forc[sens_idx[j]];
+          forc[sens_idx[j]] = forc[sens_idx[j]]*(1 + h*w[j]);
+        }
+        else {
+          old[j] = forc[sens_idx[j]];
+          forc[sens_idx[j]] = forc[sens_idx[j]] + h*w[j];
+        }
+      }
+      derivs1(&n, t, sens_y, sens_f, sens_out, ip);
+      for (j=n_sens_ent-1; j>=0; j--){
+        if (sens_k[j]!=k) continue;
+        if (sens_type[j]==0) parms[sens_idx[j]] = old[j];
+        else forc[sens_idx[j]] = old[j];
+      }
+      
+      for (i=0; i<n; i++) dS[i] = (sens_f[i] - ydot[i])/h;
+      for (i=0; i<nout; i++) yout[(k+1)*nout+i] = (sens_out[i] - yout[i])/h;
+      
+    }
+}
+
+/* Aging is linear in the state so the sensitivities age in exactly the same way */
+/* The only extra term is in births if the birth rate (forc[0]) is one of the directions (scaled or a knot) */
+void event_sens(int *n, double *t, double *y)
+{
+    int nb = *n/(n_sens+1);
+    int j, k;
+    double tot = sumsum(y,0,model_states(nb)-1);
+    
+    for (k=0; k<=n_sens; k++) event(&nb, t, y+k*nb);
+    /* With continuous aging births are in the rates of change so derivs_sens already has this term */
+    if (tb_aging) return;
+    for (j=0; j<n_sens_ent; j++){
+      if (sens_type[j]==1 && sens_idx[j]==0) y[(sens_k[j]+1)*nb] = y[(sens_k[j]+1)*nb] + sens_w[j]*birth_rate*tot/1000;
+      if (sens_type[j]==2 && sens_idx[j]==0) y[(sens_k[j]+1)*nb] = y[(sens_k[j]+1)*nb] + sens_weight(j,*t)*tot/1000;
+    }
+}
+#endif
+
+/* ###### LOCK-STEP ENSEMBLE - SEVERAL PARAMETER SETS INTEGRATED TOGETHER AS ONE SYSTEM (see run_lockstep in Batch_run.R) ###### */
+
+/* The state passed to derivs_batch/event_batch is n_batch model states one after the other, and the outputs are n_batch blocks of nout */
+/* Each member has its own parameters (set with set_batch) but they share the forcings and the solver's step size control, so a */
+/* batch of runs costs one call to the solver (and one set of R overheads) rather than one per member */
+
+static int n_batch = 0;
+static double *batch_parms = NULL;    /* parameters of member b are batch_parms[b*404 + i] */
+
+/* Called from R with .C("set_batch", B, np, p_b) where p_b is a matrix with np rows (np <= 404) and one column per member */
+void set_batch(int *B, int *np, double *p_b)
+{
+    int b, i;
+    if (*B<1) error("batch must have at least one member");
+    if (*np<1 || *np>404) error("number of parameters must be between 1 and 404");
+    batch_parms = (double *) realloc(batch_parms, (*B)*404*sizeof(double));
+    if (batch_parms==NULL) error("couldn't allocate memory for the batch parameters");
+    for (b=0; b<*B; b++){
+      for (i=0; i<404; i++) batch_parms[b*404+i] = i<*np ? p_b[b*(*np)+i] : 0.0;
+    }
+    n_batch = *B;
+}
+
+/* Not in the complex step or single precision builds (the batch parameters are double) */
+#if !defined(TB_COMPLEX_STEP) && !defined(TB_FLOAT)
+void derivs_batch(int *neq, double *t, double *y, double *ydot, double *yout, int *ip)
+{
+    int n = n_batch>0 ? *neq/n_batch : 0;
+    int ip_b[1];
+    int b;
+    
+    if (n_batch==0) error("call set_batch before running derivs_batch");
+    if (n*n_batch != *neq) error("number of states isn't a multiple of the batch size");
+    if ((ip[0]/n_batch)*n_batch != ip[0]) error("nout isn't a multiple of the batch size");
+    ip_b[0] = ip[0]/n_batch;
+    for (b=0; b<n_batch; b++) model_check(&n, ip_b, batch_parms+b*404);
+    
+    for (b=0; b<n_batch; b++){
+      model_kernel(&n, t, y+b*n, ydot+b*n, yout+b*ip_b[0], ip_b, batch_parms+b*404, forc, NULL);
+    }
+}
+#endif
+
+/* Each member ages and gets births separately (the birth rate is a forcing so is the same for all) */
+void event_batch(int *n, double *t, double *y)
+{
+    int nb = *n/n_batch;
+    int b;
+    for (b=0; b<n_batch; b++) event(&nb, t, y+b*nb);
+}
+
+/* ###### PATCHES - SUB-NATIONAL AREAS COUPLED THROUGH THE FORCE OF INFECTION (see Patches.R) ###### */
+
+/* The state passed to derivs_patch/event_patch is n_patch model states one after the other, and the outputs are n_patch blocks */
+/* of nout. The patches share the parameters but each has its own forcings (demography, HIV, ART etc.) - forcc_patch is the */
+/* initforc function, with n_patch*166 forcings (patch p is forcings p*166 to p*166+165). The only coupling is the force of */
+/* infection: each call first works out the infectious TB in each patch (per person, overall and by age), then mixes it over */
+/* the patches with the mixing matrix M (row p is how patch p mixes with the others - the identity gives independent patches), */
+/* then runs the model for each patch with the mixed values. The patches are run in parallel (threads, see THREADS above) - each */
+/* thread runs whole patches (the age loops within a patch are then not split) and the results don't depend on the threads */
+
+static int n_patch = 0;
+static double *forc_patch = NULL;     /* forcings of patch p are forc_patch[p*166 + i] */
+static double *patch_M = NULL;        /* mixing matrix (n_patch x n_patch, row major) */
+static double *patch_x = NULL;        /* infectious TB by patch - 164 values a patch (see patch_infectious) */
+static double *patch_mix = NULL;      /* the same mixed over the patches (passed to model_kernel as mix) */
+
+/* Called from R with .C("set_patch", P, M) before a run with derivs_patch (M is P x P, by column as in R) */
+void set_patch(int *P, double *M)
+{
+    int i, j;
+    if (*P<1) error("there must be at least one patch");
+    forc_patch = (double *) realloc(forc_patch, (*P)*166*sizeof(double));
+    patch_M = (double *) realloc(patch_M, (*P)*(*P)*sizeof(double));
+    patch_x = (double *) realloc(patch_x, (*P)*164*sizeof(double));
+    patch_mix = (double *) realloc(patch_mix, (*P)*164*sizeof(double));
+    if (forc_patch==NULL || patch_M==NULL || patch_x==NULL || patch_mix==NULL) error("couldn't allocate memory for the patches");
+    for (i=0; i<*P; i++){
+      for (j=0; j<*P; j++) patch_M[i*(*P)+j] = M[j*(*P)+i];
+    }
+    n_patch = *P;
+}
+
+void forcc_patch(void (* odeforcs)(int *, double *))
+{
+    int N = 166*n_patch;
+    if (n_patch==0) error("call set_patch before running derivs_patch");
+    odeforcs(&N, forc_patch);
+}
+
+/* Not in the complex step or single precision builds */
+#if !defined(TB_COMPLEX_STEP) && !defined(TB_FLOAT)
+
+/* Infectious TB per person in a patch (state y, n values) as beta*(rel_inf*N + I)/population (as the force of infection in */
+/* model_kernel) - x[0..80] DS and x[81..161] DR by age, x[162] DS and x[163] DR overall. States are ordered with age fastest */
+static void patch_infectious(int n, double *y, double *x)
+{
+    int i, k, s;
+    int nm = model_states(n);
+    int n_neg = 81*N_DIS;
+    int n_H = nm==n_neg ? 0 : 7*HIV_ON;
+    double tot[81] = {0}, inf_s[81] = {0}, inf_m[81] = {0};
+    double ws[15], wm[15], ws_H[15], wm_H[15];
+    double all_tot = 0, all_s = 0, all_m = 0;
+
+    /* Weights of each disease state (in the order they are in y) for HIV- and HIV+ */
+    for (k=0, s=0; k<15; k++){
+      if (!dis_on[k]) continue;
+      ws[s] = wm[s] = ws_H[s] = wm_H[s] = 0;
+      if (k==5 || k==6){ ws[s] = rel_inf; ws_H[s] = rel_inf_H; }     /* Nsn, Nsp */
+      if (k==7 || k==8){ wm[s] = rel_inf; wm_H[s] = rel_inf_H; }     /* Nmn, Nmp */
+      if (k==9 || k==10) ws[s] = ws_H[s] = 1;                        /* Isn, Isp */
+      if (k==11 || k==12) wm[s] = wm_H[s] = 1;                       /* Imn, Imp */
+      s++;
+    }
+    for (s=0; s<n_neg; s++){
+      k = s/81;
+      i = s%81;
+      tot[i] += y[s];
+      inf_s[i] += ws[k]*y[s];
+      inf_m[i] += wm[k]*y[s];
+    }
+    for (s=n_neg; s<nm; s++){
+      k = s<n_neg*(1+n_H) ? (s-n_neg)/(81*n_H) : (s-n_neg*(1+n_H))/(81*n_H*3);
+      i = s%81;
+      tot[i] += y[s];
+      inf_s[i] += ws_H[k]*y[s];
+      inf_m[i] += wm_H[k]*y[s];
+    }
+    for (i=0; i<81; i++){
+      x[i] = tot[i]>0 ? beta*inf_s[i]/tot[i] : 0;
+      x[81+i] = tot[i]>0 ? fit_cost*beta*inf_m[i]/tot[i] : 0;
+      all_tot += tot[i];
+      all_s += inf_s[i];
+      all_m += inf_m[i];
+    }
+    x[162] = all_tot>0 ? beta*all_s/all_tot : 0;
+    x[163] = all_tot>0 ? fit_cost*beta*all_m/all_tot : 0;
+}
+
+void derivs_patch(int *neq, double *t, double *y, double *ydot, double *yout, int *ip)
+{
+    int n = n_patch>0 ? *neq/n_patch : 0;
+    int ip_p[1];
+    int pa, q, i;
+
+    if (n_patch==0) error("call set_patch before running derivs_patch");
+    if (n*n_patch != *neq) error("number of states isn't a multiple of the number of patches");
+    if ((ip[0]/n_patch)*n_patch != ip[0]) error("nout isn't a multiple of the number of patches");
+    ip_p[0] = ip[0]/n_patch;
+    model_check(&n, ip_p, parms);
+
+    /* Coupling - infectious TB in each patch, then mixed over the patches */
+    TB_OMP_FOR(schedule(static))
+    for (pa=0; pa<n_patch; pa++) patch_infectious(n, y+pa*n, patch_x+pa*164);
+    for (pa=0; pa<n_patch; pa++){
+      for (i=0; i<164; i++){
+        double sum = 0;
+        for (q=0; q<n_patch; q++) sum += patch_M[pa*n_patch+q]*patch_x[q*164+i];
+        patch_mix[pa*164+i] = sum;
+      }
+    }
+
+    /* The model for each patch */
+    TB_OMP_FOR(schedule(dynamic))
+    for (pa=0; pa<n_patch; pa++){
+      model_kernel(&n, t, y+pa*n, ydot+pa*n, yout+pa*ip_p[0], ip_p, parms, forc_patch+pa*166, patch_mix+pa*164);
+    }
+}
+
+/* Each patch ages and gets births separately, with its own birth rate */
+void event_patch(int *n, double *t, double *y)
+{
+    int np = *n/n_patch;
+    int pa;
+    for (pa=0; pa<n_patch; pa++) age_births(&np, y+pa*np, forc_patch[pa*166]);
+}
+#endif
+
+/* ###### OPERATOR SPLITTING EVENTS (see OPERATOR SPLITTING above) ###### */
+
+/* Not in the complex step or single precision builds */
+#if !defined(TB_COMPLEX_STEP) && !defined(TB_FLOAT)
+static double *split_ydot = NULL;
+static int split_n = 0;
+
+/* Rates of the demography at state y - one call of the model */
+static void split_rates(int *n, double *t, double *y)
+{
+    int ip[1] = {42};
+    double yout[42];
+    if (*n > split_n){
+      split_ydot = (double *) realloc(split_ydot, (*n)*sizeof(double));
+      if (split_ydot==NULL) error("couldn't allocate memory for operator splitting");
+      split_n = *n;
+    }
+    model_check(n, ip, parms);
+    split_get = 1;
+    model_kernel(n, t, y, split_ydot, yout, ip, parms, forc, NULL);
+    split_get = 0;
+}
+
+/* Apply the demography exactly for dt years - mortality and migration scale each age, HIV incidence moves HIV- to HIV+ */
+/* (these commute as they act on each age separately). In the equilibrium run there are no HIV+ states so new infections are lost, as without splitting */
+static void split_apply(int n, double *y, double dt)
+{
+    int i, j, k, s;
+    int nm = model_states(n);
+    int n_H = nm==81*N_DIS ? 0 : 7*HIV_ON;
+    for (i=0; i<81; i++){
+      double fq = exp(split_q[i]*dt);
+      double fh = exp(-split_h[i]*dt);
+      for (s=i; s<nm; s+=81) y[s] = y[s]*fq;
+      for (k=0; k<N_DIS; k++){
+        double moved = y[k*81+i]*(1-fh);
+        y[k*81+i] = y[k*81+i] - moved;
+        for (j=0; j<n_H; j++) y[81*N_DIS+k*81*n_H+j*81+i] = y[81*N_DIS+k*81*n_H+j*81+i] + split_cd4[i][j]*moved;
+      }
+    }
+}
+
+/* Called every split_dt years - the second half of the last step, aging and births (at whole years), the first half of the next */
+void event_split(int *n, double *t, double *y)
+{
+    if (*t > split_t0+1e-8){
+      split_rates(n, t, y);
+      split_apply(*n, y, split_dt/2);
+    }
+    if (fabs(*t-floor(*t+0.5)) < 1e-8) event(n, t, y);
+    if (*t < split_t1-1e-8){
+      split_rates(n, t, y);
+      split_apply(*n, y, split_dt/2);
+    }
+}
+#endif
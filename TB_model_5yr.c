@@ -219,26 +219,124 @@ void forcc(void (* odeforcs)(int *, double *))
     odeforcs(&N, forc);
 }
 
+/* ###### CHECKSUM (64 bit FNV-1a) OF A BLOCK OF BYTES - USED TO VALIDATE CHECKPOINT FILES (Checkpoint.R) ###### */
+/* Called from R with .C("fnv_hash", x, length(x), h=integer(2)) where x is a raw vector, returns the hash as two 32 bit halves in h */
+void fnv_hash(unsigned char *x, int *n, int *h)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    int i;
+    for (i=0; i<*n; i++){
+      hash = (hash ^ x[i])*1099511628211ULL;
+    }
+    h[0] = (int)(unsigned int)(hash >> 32);
+    h[1] = (int)(unsigned int)(hash & 0xffffffffULL);
+}
+
 /* ##### EVENTS ARE USED TO ADD BIRTHS AND SHIFT THE POPULATION BY AGE - EQUIVALENT TO THE METHOD OF SCHENZLE ###### */
 
+/* ###### AGING - ANNUAL EVENTS (THE DEFAULT) OR CONTINUOUS (see aging in Run_model_5yr.R) ###### */
+/* With continuous aging a fifth of each age group moves up a group each year as a continuous rate (the last group, 80+, has no */
+/* outflow) and births go into S in age 0 as they happen, both as terms in the rates of change - so the solver doesn't have to */
+/* stop at each year. event() then does nothing */
+
+static int tb_aging = 0;    /* 0 = annual events, 1 = continuous */
+
+/* Called from R with .C("set_aging", continuous) */
+void set_aging(int *continuous)
+{
+    tb_aging = *continuous;
+}
+
+/* ###### AGE MIXING - FORCE OF INFECTION FROM A CONTACT MATRIX (see contact in Run_model_5yr.R and Contact.R) ###### */
+/* As in TB_model.c - with a contact matrix C the force of infection at age i is sum_j C[i][j]*x[j], where x[j] is beta times */
+/* the infectious TB at age j over the population at age j. C is passed in full (17 x 17) or as low rank factors C = U*V' */
+
+static int tb_contact = 0;             /* 0 = homogeneous, 1 = full matrix, 2 = low rank */
+static int contact_n = 0;              /* number of ages */
+static int contact_rank = 0;
+static double contact_U[17*17];        /* C (n_age x n_age) or U (n_age x rank), row major */
+static double contact_V[17*17];        /* V (n_age x rank), row major */
+
+/* Called from R with .C("set_contact", mode, n_age, rank, U, V) - U is C for mode 1 (rank and V are then not used) */
+void set_contact(int *mode, int *n, int *rank, double *U, double *V)
+{
+    int i;
+    if (*mode<0 || *mode>2) error("contact mode must be 0, 1 or 2");
+    if (*mode>0 && *n!=17) error("contact matrix must be 17 x 17 for this model");
+    if (*mode==2 && (*rank<1 || *rank>17)) error("contact rank must be between 1 and 17");
+    tb_contact = *mode;
+    contact_n = *n;
+    contact_rank = *mode==2 ? *rank : *n;
+    if (*mode==1) for (i=0; i<(*n)*(*n); i++) contact_U[i] = U[i];
+    if (*mode==2){
+      for (i=0; i<(*n)*(*rank); i++){
+        contact_U[i] = U[i];
+        contact_V[i] = V[i];
+      }
+    }
+}
+
+/* Force of infection by age (FS_age, FM_age) from x for each strain (xs, xm) */
+static void contact_foi(double *xs, double *xm, double *FS_age, double *FM_age)
+{
+    int i, j, k;
+    int n = contact_n, rk = contact_rank;
+    if (tb_contact==1){
+      for (i=0; i<n; i++){
+        const double *Ci = contact_U + i*n;
+        double fs = 0, fm = 0;
+        for (j=0; j<n; j++){
+          fs += Ci[j]*xs[j];
+          fm += Ci[j]*xm[j];
+        }
+        FS_age[i] = fs;
+        FM_age[i] = fm;
+      }
+    }
+    else {
+      double ws[17] = {0}, wm[17] = {0};
+      for (j=0; j<n; j++){
+        const double *Vj = contact_V + j*rk;
+        for (k=0; k<rk; k++){
+          ws[k] += Vj[k]*xs[j];
+          wm[k] += Vj[k]*xm[j];
+        }
+      }
+      for (i=0; i<n; i++){
+        const double *Ui = contact_U + i*rk;
+        double fs = 0, fm = 0;
+        for (k=0; k<rk; k++){
+          fs += Ui[k]*ws[k];
+          fm += Ui[k]*wm[k];
+        }
+        FS_age[i] = fs;
+        FM_age[i] = fm;
+      }
+    }
+}
+
 void event(int *n, double *t, double *y) 
 {
   int i;
   
+  /* With continuous aging there is nothing to do (see AGING above) */
+  if (tb_aging) return;
+  
+  /* n is the number of states passed in - all of them, or just the HIV- states in the equilibrium run */
   /* Store current population in temp and shift 1/5 every age group forward one */
   double temp[7395];
   temp[0] = y[0];
-  for (i=1; i<7395; i++){
+  for (i=1; i<*n; i++){
     temp[i] = y[i];
     y[i] = (temp[i]*4/5) + (temp[i-1]/5);
   }
   /* Set every 0 age group to 4/5 of current value and every >80 age group to 1/5 previous age group plus those still surviving  */
-  for (i=0; i<7395; i+=17) {
+  for (i=0; i<*n; i+=17) {
     y[i] = (temp[i]*4/5);
     y[i+16] = temp[i+16] + temp[i+15]/5;  
   }
   /* Then add births into group 0 - only susceptibles get born */ 
-  y[0] = y[0] + birth_rate*sumsum(temp,0,7394)/1000;
+  y[0] = y[0] + birth_rate*sumsum(temp,0,*n-1)/1000;
 
 }
 
@@ -298,6 +396,13 @@ void derivs5(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
     int n_ART = 3;      /* Number of ART groups */
     int n_disease = 15; /* Number of disease states */
     
+    /* The equilibrium run only passes in the HIV- states (n_age*n_disease) - all HIV+ and ART states are then zero */
+    /* so setting n_HIV to 0 skips every HIV/ART loop below, including reading them from y and writing them to ydot */
+    if (*neq == n_age*n_disease){
+      if (HIV_run>0.0) error("HIV_run must be 0 if only the HIV- states are passed in");
+      n_HIV = 0;
+    }
+    
     for (i=0; i<n_age; i++) S[i] = y[i];             
     for (i=n_age; i<n_age*2; i++) Lsn[i-n_age] = y[i];       
     for (i=n_age*2; i<n_age*3; i++) Lsp[i-n_age*2] = y[i];       
@@ -745,9 +850,47 @@ void derivs5(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
     /* Total on or starting ART - if zero use it to skip running ART derivs */
     double ART_all = sumsum(Tot_ART,0,16) + sumsum(ART_new,0,16);
 
-    /* Force of infection */
-    double FS = beta*(Total_Ns_N*rel_inf + Total_Ns_H*rel_inf_H + Total_Is_N + Total_Is_H)/Total; 
-    double FM = fit_cost*beta*(Total_Nm_N*rel_inf + Total_Nm_H*rel_inf_H + Total_Im_N + Total_Im_H)/Total; 
+    /* Force of infection - the same at every age unless there is a contact matrix (see AGE MIXING above) */
+    /* FS_all and FM_all are the averages over the whole population (outputs FS and FM) */
+    double FS_all = beta*(Total_Ns_N*rel_inf + Total_Ns_H*rel_inf_H + Total_Is_N + Total_Is_H)/Total; 
+    double FM_all = fit_cost*beta*(Total_Nm_N*rel_inf + Total_Nm_H*rel_inf_H + Total_Im_N + Total_Im_H)/Total; 
+    double FS_age[17];
+    double FM_age[17];
+    if (tb_contact){
+      double xs[17], xm[17];
+      for (i=0; i<n_age; i++){
+        double Ns_H = 0, Nm_H = 0, Is_H = 0, Im_H = 0;
+        for (j=0; j<n_HIV; j++){
+          Ns_H = Ns_H + Nsn_H[i][j]+Nsp_H[i][j];
+          Nm_H = Nm_H + Nmn_H[i][j]+Nmp_H[i][j];
+          Is_H = Is_H + Isn_H[i][j]+Isp_H[i][j];
+          Im_H = Im_H + Imn_H[i][j]+Imp_H[i][j];
+          for (l=0; l<n_ART; l++){
+            Ns_H = Ns_H + Nsn_A[i][j][l]+Nsp_A[i][j][l];
+            Nm_H = Nm_H + Nmn_A[i][j][l]+Nmp_A[i][j][l];
+            Is_H = Is_H + Isn_A[i][j][l]+Isp_A[i][j][l];
+            Im_H = Im_H + Imn_A[i][j][l]+Imp_A[i][j][l];
+          }
+        }
+        xs[i] = xm[i] = 0;
+        if (tot_age[i]>0.0){
+          xs[i] = beta*((Nsn[i]+Nsp[i])*rel_inf + Ns_H*rel_inf_H + Isn[i]+Isp[i] + Is_H)/tot_age[i];
+          xm[i] = fit_cost*beta*((Nmn[i]+Nmp[i])*rel_inf + Nm_H*rel_inf_H + Imn[i]+Imp[i] + Im_H)/tot_age[i];
+        }
+      }
+      contact_foi(xs,xm,FS_age,FM_age);
+      FS_all = FM_all = 0;
+      for (i=0; i<n_age; i++){
+        FS_all = FS_all + FS_age[i]*tot_age[i]/Total;
+        FM_all = FM_all + FM_age[i]*tot_age[i]/Total;
+      }
+    }
+    else {
+      for (i=0; i<n_age; i++){
+        FS_age[i] = FS_all;
+        FM_age[i] = FM_all;
+      }
+    }
     
     /* Variables to store numbers of new cases */
     double TB_cases_age[17] = {0};
@@ -766,6 +909,9 @@ void derivs5(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
 
     for (i=0; i<n_age; i++){
       
+      double FS = FS_age[i];   /* Force of infection at this age */
+      double FM = FM_age[i];
+      
       /* Calculate the disease flows here and use these in the derivatives - intention is to make the model more flexible/easier to understand */
       
       double S_to_Lsn = FS*(1-a_age[i])*S[i];                                     /* Susceptible to latent DS infection (no disease history) */
@@ -1627,6 +1773,15 @@ void derivs5(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
       }
     }
     
+    /* Continuous aging and births (see AGING above) */
+    if (tb_aging){
+      for (ij=0; ij<*neq; ij+=n_age){
+        for (i=n_age-1; i>0; i--) ydot[ij+i] = ydot[ij+i] + y[ij+i-1]/5 - (i<n_age-1 ? y[ij+i]/5 : 0);
+        ydot[ij] = ydot[ij] - y[ij]/5;
+      }
+      ydot[0] = ydot[0] + births;
+    }
+    
     /* Calculate notifications, treatments etc */
     double DS_correct = 0;
     double DS_incorrect = 0; 
@@ -1725,8 +1880,8 @@ void derivs5(int *neq, double *t, double *y, double *ydot, double *yout, int *ip
     yout[10] = Total_I;
     yout[11] = Total_DS;
     yout[12] = Total_MDR;
-    yout[13] = FS*100;
-    yout[14] = FM*100;
+    yout[13] = FS_all*100;
+    yout[14] = FM_all*100;
     yout[15] = CD4_dist_all[0];
     yout[16] = CD4_dist_all[1];
     yout[17] = CD4_dist_all[2];